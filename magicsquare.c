@@ -14,6 +14,7 @@
  * You should have received a copy of the GNU General Public License
  * along with the magic-square.  If not, see <https://www.gnu.org/licenses/>.
  */
+/** Size of the magic squares generated by default, changed with -n SIZE. */
 #define N 5
 
 /** Filter level 0 does not filter the squares,
@@ -29,8 +30,11 @@
  * column, the last row and the 2nd number in the row previous to the last,
  * 2 prints the long reduced version of numbers without spaces printing one
  * line per square and one character for each number,
- * 3 prints one line per square of decimal numbers separated by commas, and
- * 4 prints rows of decimal numbers separated by spaces ended by empty lines: */
+ * 3 prints one line per square of decimal numbers separated by commas,
+ * 4 prints rows of decimal numbers separated by spaces ended by empty lines,
+ * 5 writes the numbers of the short reduced version packed in bits, after a
+ * header with the size, the filter level and the format, and
+ * 6 writes the numbers of the long reduced version packed in bits: */
 #define PRINT_STYLE 1
 
 /** Fills the holes as soon as possible when it is clear which number goes. */
@@ -39,10 +43,54 @@
 /** Prints the reason to discard the numbers, for debugging. */
 #define PRINT_CHECKS 0
 
+/** Updates the sums of the available numbers when they are removed or restored
+ * and checks again only the lines that changed, instead of all of them. */
+#define INCREMENTAL_CHECKS 0
+
+/** Stores the available numbers and positions as bits of 64-bit words instead
+ * of double-linked lists, finding the next and previous ones with ctz/clz. */
+#define SORTEDNLIST_BITS 0
+
+/** Number of empty positions from which the squares are counted without the
+ * stack of the search when they are not printed, changed with -T NUM. */
+#define TAIL_CELLS 10
+
+/** Number of tried numbers after which the subtrees of the search are split
+ * between the threads, being 4 the numbers tried for the four corners. */
+#define CUT_DEPTH 4
+
+/** Seconds between the checkpoints saved to resume the search later. */
+#define CHECKPOINT_INTERVAL 300
+
+/** Megabytes of memory used to find the repeated squares when removing them,
+ * writing to temporary files the squares that do not fit, changed with
+ * -M MB. */
+#define DEDUP_MEMORY 256
+
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include "sumsquare.c"
 #include "sumsquareio.c"
+#include "sumsquarewriter.c"
+#include "sortedruns.c"
+#if SORTEDNLIST_BITS
+#include "sortednlistbits.c"
+#else
 #include "sortednlist.c"
+#endif
 #include "sortednlistsums.c"
+#include "sumsets.c"
 #define NDEBUG
 #include <assert.h>
 
@@ -67,75 +115,85 @@ void magicsquare_printchecks(sortednlist nl, sortednlistsums sm, sumsquare sq) {
 }
 #endif
 
-/** Returns if the available numbers could fill the holes of each line to get
- * the magic sum by adding to them the current minimum and maximum sums, and
- * also saves in the given address the index of the first line found with only
- * one hole as candidate to be filled, or -1 if there is no lines with holes. */
-char magicsquare_checksums(sumsquare sq, sortednlist nl, sortednlistsums sm,
-		int msum, int *pln1hole) {
-	int l, nlines = sumsquare_nlines(sq), ln1hole = -1;
-	sumsquare_linecount line;
-	int *minsums, *maxsums;
-	char r = 1;
-	sortednlistsums_get(sm, nl);
-	minsums = sm->minsums;
-	maxsums = sm->maxsums;
-	for (l = 0; l < nlines; l++) {
-		line = sumsquare_getlinecount(sq, l);
-		if (line.holes) {
-			assert(line.holes <= sm->len);
-			if (line.sum + minsums[line.holes - 1] > msum) {
+/* returns the bit of the given line in the masks of lines */
+#define MAGSQ_LINEBIT(l) (1ULL << (l))
+
+/* limits of the side, since the numbers of the lists are unsigned char */
+#define MAGSQ_MINSIDE 3
+#define MAGSQ_MAXSIDE 15
+
+/* reasons to discard a number counted by the statistics of the search: the
+ * sums of the lines and the conditions of magicsquare_equivcondition */
+#define MAGSQ_MINSUM 0
+#define MAGSQ_MAXSUM 1
+#define MAGSQ_NOTAVAILABLE 2
+#define MAGSQ_FULLLINE 3
+#define MAGSQ_NOSUMSET 4
+#define MAGSQ_LINEPAIR 5
+#define MAGSQ_ROTATION 6
+#define MAGSQ_REFLECTION 7
+#define MAGSQ_BORDERS 8
+#define MAGSQ_ADJACENT 9
+#define MAGSQ_NREASONS 10
+
+static const char *magicsquare_reasons[MAGSQ_NREASONS] = {
+	"min-sum", "max-sum", "one-hole", "full-line", "line-set",
+	"line-pair", "rotation", "reflection", "borders", "adjacent"
+};
+
+/** Returns if the available numbers could fill the holes of the given line to
+ * get its given magic sum by adding to it the current minimum and maximum
+ * sums, if the number needed by a line with only one hole is available and if
+ * a line without holes has the magic sum, counting in prunes the reason to
+ * fail. */
+char magicsquare_checkline(sumsquare sq, sortednlist nl, sortednlistsums sm,
+		int msum, int l, unsigned long long *prunes) {
+	sumsquare_linecount line = sumsquare_getlinecount(sq, l);
+	if (line.holes) {
+		assert(line.holes <= sm->len);
+		if (line.sum + sm->minsums[line.holes - 1] > msum) {
 #if PRINT_CHECKS
 printf("INVALID sum=%d holes=%d minsum=%d\n", line.sum, line.holes,
-	line.sum + minsums[line.holes - 1]);
+	line.sum + sm->minsums[line.holes - 1]);
 magicsquare_printchecks(nl, sm, sq);
 #endif
-				r = 0;
-				break;
-			} else if (line.sum + maxsums[line.holes - 1] < msum) {
+			prunes[MAGSQ_MINSUM]++;
+			return 0;
+		} else if (line.sum + sm->maxsums[line.holes - 1] < msum) {
 #if PRINT_CHECKS
 printf("INVALID sum=%d holes=%d maxsum=%d\n", line.sum, line.holes,
-	line.sum + maxsums[line.holes - 1]);
+	line.sum + sm->maxsums[line.holes - 1]);
 magicsquare_printchecks(nl, sm, sq);
 #endif
-				r = 0;
-				break;
-			} else if (line.holes == 1) {
-				if (sortednlist_isremoved(nl, msum - line.sum)){
+			prunes[MAGSQ_MAXSUM]++;
+			return 0;
+		} else if (line.holes == 1
+				&& sortednlist_isremoved(nl, msum - line.sum)) {
 #if PRINT_CHECKS
 printf("INVALID sum=%d holes=1 notavailable=%d\n", line.sum,
 	msum - line.sum);
 magicsquare_printchecks(nl, sm, sq);
 #endif
-					r = 0;
-					break;
-				} else if (ln1hole < 0) {
-					ln1hole = l;
-				}
-			}
-		} else if (line.sum != msum) {
+			prunes[MAGSQ_NOTAVAILABLE]++;
+			return 0;
+		}
+	} else if (line.sum != msum) {
 #if PRINT_CHECKS
 printf("INVALID sum=%d holes=0\n", line.sum);
 magicsquare_printchecks(nl, sm, sq);
 #endif
-			r = 0;
-			break;
-		}
+		prunes[MAGSQ_FULLLINE]++;
+		return 0;
 	}
-#if PRINT_CHECKS
-if (r) {
-	printf("OK!\n");
-	magicsquare_printchecks(nl, sm, sq);
-}
-#endif
-	*pln1hole = r && ln1hole > -1 ? ln1hole : -1;
-	return r;
+	return 1;
 }
 
 #define CELLIDXFROMIJ(i, j, side) ((i) * (side) + (j))
 
 /**
- * Returns 0 if the square does not pass the checks for the given filter level.
+ * Returns 0 if the square passes the checks for the given filter level, or the
+ * number from 1 to 4 of the first condition described below that it does not
+ * pass, being the square filtered by magicsquare_checkequiv in this case.
  *
  * The following magic squares are not generated when filterlevel < 1:
  * Every magic square has other three magic squares obtained by rotating the
@@ -239,13 +297,13 @@ if (r) {
  *     | 3|19|25|11| 7|
  *     |15| 5|10|22|13|
  *     |21|17| 4|14| 9| */
-char magicsquare_checkequiv(sumsquare sq, char filterlevel) {
+char magicsquare_equivcondition(sumsquare sq, char filterlevel) {
 	int side, last;
 	int topleft, topright, botleft, botright;
 	int topleft2, topright2, botleft2, botright2;
 	side = sq->side;
 	if (filterlevel < 1 || side < 2) {
-		return 1;
+		return 0;
 	}
 	last = side - 1;
 	topleft = sumsquare_getnum(sq, CELLIDXFROMIJ(0, 0, side));
@@ -262,10 +320,10 @@ printf("INVALID topleft=%d > topright=%d | botleft=%d | botright=%d\n",
 	topleft, topright, botleft, botright);
 sumsquare_printsums(sq);
 #endif
-		return 0;
+		return 1;
 	}
 	if (filterlevel < 2) {
-		return 1;
+		return 0;
 	}
 	/* the top-right corner must be less than bottom-left
 	 * (to discard 1 of 2 reflections): */
@@ -274,10 +332,10 @@ sumsquare_printsums(sq);
 printf("INVALID topright=%d > botleft=%d\n", topright, botleft);
 sumsquare_printsums(sq);
 #endif
-		return 0;
+		return 2;
 	}
 	if (filterlevel < 3 || side < 4) {
-		return 1;
+		return 0;
 	}
 	/* the second in the main diagonal must be less than its opposite
 	 * (to discard 1 of 2 interchange of borders): */
@@ -288,10 +346,10 @@ sumsquare_printsums(sq);
 printf("INVALID topleft2=%d > botright2=%d\n", topleft2, botright2);
 sumsquare_printsums(sq);
 #endif
-		return 0;
+		return 3;
 	}
 	if (filterlevel < 4) {
-		return 1;
+		return 0;
 	}
 	/* the minor exterior corner must be less than all the interior corners
 	 * (to discard 1 of 2 interchange of borders with interior lines): */
@@ -305,9 +363,110 @@ printf("INVALID topleft=%d > topleft2=%d | topright2=%d | botleft2=%d\n",
 		topleft, topleft2, topright2, botleft2);
 sumsquare_printsums(sq);
 #endif
-		return 0;
+		return 4;
 	}
-	return 1;
+	return 0;
+}
+
+/** Returns 1 if the square passes the checks for the given filter level. */
+#define magicsquare_checkequiv(sq, filterlevel) \
+	(! magicsquare_equivcondition(sq, filterlevel))
+
+/** Same as magicsquare_checkequiv but counting in prunes the condition that the
+ * square does not pass. */
+char magicsquare_countequiv(sumsquare sq, char filterlevel,
+				unsigned long long *prunes) {
+	int cond = magicsquare_equivcondition(sq, filterlevel);
+	if (cond) {
+		prunes[MAGSQ_ROTATION + cond - 1]++;
+	}
+	return ! cond;
+}
+
+/* bytes of the tables of the 32 symmetries of the magic squares of a side */
+#define MAGSQ_SYMMETRIESBYTES(side) (32 * (side) * (side))
+
+/** Saves in the given array the tables of the transformations of the magic
+ * squares that are filtered with the given filter level, returning their number
+ * (4 rotations, 8 with the reflections, 16 with the interchange of opposite
+ * borders and 32 with the interchange of borders with adjacent lines, the last
+ * two only from 4x4), so all the squares filtered by magicsquare_checkequiv can
+ * be obtained from the generated ones. The table of each transformation has for
+ * each cell the cell of the original square with its number, as required by
+ * sumsquare_permute, and the first table is the identity. */
+int magicsquare_symmetries(SUMSQ_NUMTYPE *tables, int side, char filterlevel) {
+	int k, ntables, nd4, d, h, i, j, ri, rj, t, last = side - 1;
+	int rows[4][MAGSQ_MAXSIDE];
+	nd4 = filterlevel < 1 ? 1 : filterlevel < 2 ? 4 : 8;
+	ntables = filterlevel < 3 || side < 4 ? 1 : filterlevel < 4 ? 2 : 4;
+	/* interchanges of lines of the rows/columns */
+	for (h = 0; h < 4; h++) {
+		for (i = 0; i < side; i++) {
+			rows[h][i] = i;
+		}
+		if (h & 1) {
+			rows[h][0] = last;
+			rows[h][last] = 0;
+		}
+		if (h & 2) {
+			t = rows[h][0];
+			rows[h][0] = rows[h][1];
+			rows[h][1] = t;
+			t = rows[h][last];
+			rows[h][last] = rows[h][last - 1];
+			rows[h][last - 1] = t;
+		}
+	}
+	for (k = 0; k < nd4 * ntables; k++, tables += side * side) {
+		d = k % nd4;
+		h = k / nd4;
+		for (i = 0; i < side; i++) {
+			for (j = 0; j < side; j++) {
+				ri = d & 4 ? j : i; /* reflected */
+				rj = d & 4 ? i : j;
+				switch (d & 3) { /* rotated clockwise d times */
+				case 1:
+					t = ri; ri = last - rj; rj = t;
+					break;
+				case 2:
+					ri = last - ri; rj = last - rj;
+					break;
+				case 3:
+					t = ri; ri = rj; rj = last - t;
+					break;
+				}
+				tables[CELLIDXFROMIJ(i, j, side)] =
+					CELLIDXFROMIJ(rows[h][ri],
+						rows[h][rj], side);
+			}
+		}
+	}
+	return nd4 * ntables;
+}
+
+/** Returns the canonical form of the given magic square among the squares
+ * obtained with the given tables of symmetries, saved in one of the two given
+ * squares: the one that passes magicsquare_checkequiv with the given filter
+ * level, that is unique from 3x3 to 5x5 with the tables of that filter level,
+ * or the smallest one comparing the numbers of their cells in order when more
+ * than one or none of them pass. */
+sumsquare magicsquare_canonical(sumsquare sq, sumsquare var, sumsquare best,
+		const SUMSQ_NUMTYPE *tables, int ntables, char filterlevel) {
+	int k, ncells = sumsquare_ncells(sq);
+	char pass, bestpass = 0;
+	sumsquare t;
+	for (k = 0; k < ntables; k++) {
+		sumsquare_permute(var, sq, tables + k * ncells);
+		pass = magicsquare_checkequiv(var, filterlevel);
+		if (k == 0 || pass > bestpass || (pass == bestpass
+				&& memcmp(var->nums, best->nums, ncells) < 0)) {
+			t = best;
+			best = var;
+			var = t;
+			bestpass = pass;
+		}
+	}
+	return best;
 }
 
 /** Reorders the given list of positions in the square moving to the beginning
@@ -335,6 +494,68 @@ void magicsquare_initpositionsorder(sortednlist pl, int side) {
 	}
 }
 
+/* returns if the given cell is one of the corners or the interior corners, the
+ * cells read by magicsquare_checkequiv */
+#define MAGSQ_ISEQUIVCELL(cellidx, side, last) \
+	MAGSQ_ISEQUIVIJ(SUMSQ_IFROMPOS(cellidx, side), \
+			SUMSQ_JFROMPOS(cellidx, side), last)
+#define MAGSQ_ISEQUIVIJ(i, j, last) \
+	(((i) < 2 || (i) > (last) - 2) && ((i) == (j) || (i) + (j) == (last)))
+
+/** Returns the cell shared by the two given lines l1 < l2, or -1 if they do
+ * not cross, as two rows, two columns or the diagonals of an even side. */
+static inline int magicsquare_crosscell(int side, int l1, int l2) {
+	int last = side - 1;
+	if (l1 < side) {
+		return l2 < side ? -1
+			: l2 < SUMSQ_SIDE2(side) ? l1 * side + l2 - side
+			: l2 == SUMSQ_SIDE2(side) ? l1 * side + l1
+			: l1 * side + last - l1;
+	} else if (l1 < SUMSQ_SIDE2(side)) {
+		return l2 < SUMSQ_SIDE2(side) ? -1
+			: l2 == SUMSQ_SIDE2(side)
+				? (l1 - side) * side + l1 - side
+			: (last - l1 + side) * side + l1 - side;
+	}
+	return side % 2 ? (side / 2) * side + side / 2 : -1;
+}
+
+/** Returns the number of empty cells shared by the two given lines, for the
+ * lines that are not the ones of the magic squares, that can share two. */
+static int magicsquare_sharedholes(sumsquare sq, int l1, int l2) {
+	sumsquare_linerelation line = sumsquare_getlinerelation(sq, l1);
+	sumsquare_cellrelation cell;
+	int c, k, shared = 0;
+	for (c = 0; c < line.nlinecells; c++) {
+		if (sumsquare_getnum(sq, line.linecells[c]) == 0) {
+			cell = sumsquare_getcellrelation(sq, line.linecells[c]);
+			for (k = 0; k < cell.ncelllines; k++) {
+				shared += cell.celllines[k] == l2;
+			}
+		}
+	}
+	return shared;
+}
+
+/** Narrows the given range of the numbers that can be written in an empty cell
+ * of the given line, to get its given magic sum with the remaining holes of the
+ * line filled with the smallest or the biggest available numbers. */
+static inline void magicsquare_narrow(sumsquare sq, sortednlistsums sm,
+				int msum, int l, int *plo, int *phi) {
+	sumsquare_linecount line = sumsquare_getlinecount(sq, l);
+	int rest = msum - line.sum, lo = rest, hi = rest;
+	if (line.holes > 1) {
+		lo -= sm->maxsums[line.holes - 2];
+		hi -= sm->minsums[line.holes - 2];
+	}
+	if (lo > *plo) {
+		*plo = lo;
+	}
+	if (hi < *phi) {
+		*phi = hi;
+	}
+}
+
 #define MAGSQ_EMPTYPOS 0
 #define MAGSQ_TRIEDNUM 1
 #define MAGSQ_DERIVEDNUM 2
@@ -346,137 +567,3519 @@ void magicsquare_initnumtypes(char *arr, int size) {
 	}
 }
 
-/** Inserts the given number as a derived number in the given position.
- * A derived number is added when no other number can be in that position,
- * and they must be removed cleanly in the same way that they were added. */
-void magicsquare_insertderivednum(sumsquare sq, sortednlist nl, sortednlist pl,
-				char *numtypes, int pos, int num) {
-#if PRINT_CHECKS
-printf("INSERT DERIVED pos=%d num=%d\n", pos, num);
+/* rounds the size of each part of the search state to keep them aligned */
+#define MAGSQ_ALIGNED(bytes) ((((bytes) + 15) / 16) * 16)
+
+/** Counters of the search of a state, always updated since they are cheap: the
+ * numbers written for each depth (the number of positions written) and for each
+ * position, the derived numbers and the numbers discarded by each reason. */
+typedef struct magicsquare_stats_st {
+	unsigned long long nderived, prunes[MAGSQ_NREASONS];
+	unsigned long long *depthnodes, *posnodes;
+} magicsquare_stats;
+
+/** Copy of the statistics of a state and of its count of squares, published
+ * by the thread that searches with it so that other threads can read it. */
+typedef struct magicsquare_snapshot_st {
+	atomic_ulong cricount;
+	atomic_ullong nderived, prunes[MAGSQ_NREASONS];
+	atomic_ullong *depthnodes, *posnodes;
+} magicsquare_snapshot;
+
+/**
+ * magicsquare - State of the search of the magic squares of one size, packing
+ * the square, the lists of available numbers and positions, the sums of the
+ * available numbers and the type of number saved in each position, together
+ * with the current position, the count of squares found and the unit of work
+ * being searched. To create the state for a given size, a char array of size
+ * MAGICSQUARE_BYTES(side) must be initialized by calling to
+ * magicsquare_init(array, side, ...) that returns the array of type
+ * magicsquare.
+ * When the cut depth is not zero, every state only searches the subtrees found
+ * after trying cutdepth numbers that it claims from a counter shared by all the
+ * states, so many threads can split the search, each one with its own state,
+ * and only the subtrees of its shard when the search is split in nshards.
+ * The first base positions of the stack are fixed and never restored, and the
+ * positions marked as split have their remaining numbers given to other state.
+ * For each number in the stack it saves the mask of lines with only one hole.
+ * With the table of the sets of numbers of the lines, it also keeps the mask of
+ * the used numbers to check if the lines can be completed with one of them.
+ * The squares found are written to the standard output with its own writer.
+ * The calls to setnext are counted for benchmarks, and the numbers written and
+ * discarded are counted in the statistics of the state.
+ */
+typedef struct magicsquare_st {
+	sumsquare sq;
+	sortednlist nl, pl;
+	sortednlistsums sm;
+	char *numtypes, *splits;
+#if INCREMENTAL_CHECKS
+	unsigned long long *oneholes;
 #endif
-	assert(numtypes[pos - 1] == MAGSQ_EMPTYPOS);
-	assert(! sumsquare_getnum(sq, pos - 1));
-	assert(! sortednlist_isremoved(nl, num));
-	assert(! sortednlist_isremoved(pl, pos));
-	sortednlist_remove(nl, num);
-	sumsquare_setnum(sq, pos - 1, num);
-	numtypes[pos - 1] = MAGSQ_DERIVEDNUM;
-	sortednlist_remove(pl, pos);
-}
-
-/** Removes the number in the given position marked as a derived number.
- * A derived number is added when no other number can be in that position,
- * and they must be removed cleanly in the same way that they were added. */
-void magicsquare_removederivednum(sumsquare sq, sortednlist nl, sortednlist pl,
-				char *numtypes, int pos) {
-#if PRINT_CHECKS
-printf("REMOVE DERIVED pos=%d num=%d\n", pos, sumsquare_getnum(sq, pos - 1));
+	unsigned long long usednums;
+	sumsets sets;
+	char filterlevel, printstyle, fillderived, dynamicorder, linepairs;
+	int side, msum, pos, ntried, cutdepth, base, id, ckinterval, tailcells;
+	int shard, nshards;
+	unsigned long cricount, unit, myunit;
+	unsigned int round;
+	unsigned long long nsetnext;
+	magicsquare_stats stats;
+	magicsquare_snapshot snapshot;
+	const char *ckfile;
+	sumsquare_writer out;
+	atomic_ulong *nextunit;
+	atomic_int stealreq, taskstatus;
+	atomic_ulong progress, progresssquares;
+	atomic_ullong progressnodes;
+	struct magicsquare_pool_st *pool;
+} *magicsquare;
+
+/** Group of states of the threads that split the search, counting the idle
+ * ones that are trying to steal the work not yet done by the other states,
+ * and locking the output shared by their writers. The reports requested by
+ * the signals are printed in rounds, counting the states that did not
+ * publish their snapshot in the current round. */
+typedef struct magicsquare_pool_st {
+	int nstates;
+	atomic_int nidle;
+	atomic_uint round;
+	atomic_int npending, reports;
+	magicsquare *states;
+	pthread_mutex_t outlock;
+} *magicsquare_pool;
+
+/* values of stealreq, the index of the requesting state plus one otherwise */
+#define MAGSQ_NOREQUEST 0
+#define MAGSQ_CLOSED (-1)
+
+/* values of taskstatus */
+#define MAGSQ_NOTASK 0
+#define MAGSQ_WAITING 1
+#define MAGSQ_GOTTASK 2
+
+/* value of progress for the whole search, with the fraction done scaled */
+#define MAGSQ_PROGRESSSCALE 0xFFFFFFFFUL
+
+/* bytes of the buffer of the writer of each state */
+#define MAGSQ_OUTPUTBYTES 65536
+
+/* bytes of the masks of lines with one hole of each depth, only used with
+ * INCREMENTAL_CHECKS, that limits the lines to 64 */
+#if INCREMENTAL_CHECKS
+#define MAGSQ_ONEHOLESBYTES(side) \
+	MAGSQ_ALIGNED(((side) * (side) + 1) * sizeof(unsigned long long))
+#else
+#define MAGSQ_ONEHOLESBYTES(side) 0
+#endif
+
+#define MAGICSQUARE_BYTES(side) \
+	(MAGSQ_ALIGNED(sizeof(struct magicsquare_st)) \
+		+ MAGSQ_ALIGNED(SUMSQUARE_BYTES(side)) \
+		+ MAGSQ_ALIGNED(SORTEDNLIST_BYTES((side) * (side))) \
+		+ MAGSQ_ALIGNED(SORTEDNLIST_BYTES((side) * (side))) \
+		+ MAGSQ_ALIGNED(SORTEDNLISTSUMS_BYTES(side, (side) * (side))) \
+		+ MAGSQ_ONEHOLESBYTES(side) \
+		+ MAGSQ_ALIGNED(((side) * (side) + (side) * (side) + 1) \
+			* sizeof(unsigned long long)) \
+		+ MAGSQ_ALIGNED(((side) * (side) + (side) * (side) + 1) \
+			* sizeof(atomic_ullong)) \
+		+ MAGSQ_ALIGNED(SUMSQUARE_WRITER_BYTES(side, \
+					MAGSQ_OUTPUTBYTES)) \
+		+ ((side) * (side)) + ((side) * (side)))
+
+/* initializes to 0 the given snapshot, with its arrays in the given memory */
+static void magicsquare_initsnapshot(magicsquare_snapshot *s, char *mem,
+					int ncells) {
+	int k;
+	s->depthnodes = (atomic_ullong *) mem;
+	s->posnodes = s->depthnodes + ncells + 1;
+	for (k = 0; k < ncells + ncells + 1; k++) {
+		atomic_init(s->depthnodes + k, 0);
+	}
+	for (k = 0; k < MAGSQ_NREASONS; k++) {
+		atomic_init(s->prunes + k, 0);
+	}
+	atomic_init(&s->nderived, 0);
+	atomic_init(&s->cricount, 0);
+}
+
+/** Must receive as arguments an array of MAGICSQUARE_BYTES(side) bytes, the
+ * same side, the kinds of lines of the squares and the options of the search,
+ * and returns the same array initialized as a magicsquare ready to search all
+ * the squares from the first position. */
+magicsquare magicsquare_init(char *mem, int side, char lines, char filterlevel,
+				char printstyle, char fillderived) {
+	magicsquare ms = (magicsquare) mem;
+	mem += MAGSQ_ALIGNED(sizeof(struct magicsquare_st));
+	ms->sq = sumsquare_init(mem, side, lines);
+	mem += MAGSQ_ALIGNED(SUMSQUARE_BYTES(side));
+	ms->nl = sortednlist_init(mem, side * side);
+	mem += MAGSQ_ALIGNED(SORTEDNLIST_BYTES(side * side));
+	ms->pl = sortednlist_init(mem, side * side);
+	mem += MAGSQ_ALIGNED(SORTEDNLIST_BYTES(side * side));
+	ms->sm = sortednlistsums_init(mem, side, side * side);
+	sortednlistsums_get(ms->sm, ms->nl);
+	mem += MAGSQ_ALIGNED(SORTEDNLISTSUMS_BYTES(side, side * side));
+#if INCREMENTAL_CHECKS
+	ms->oneholes = (unsigned long long *) mem;
+	ms->oneholes[0] = 0;
 #endif
-	assert(numtypes[pos - 1] == MAGSQ_DERIVEDNUM);
-	assert(sumsquare_getnum(sq, pos - 1));
-	assert(sortednlist_nremoved(nl));
-	assert(sortednlist_lastremoved(nl) == sumsquare_getnum(sq, pos - 1));
-	assert(sortednlist_nremoved(pl));
-	assert(pos == sortednlist_lastremoved(pl));
-	sortednlist_restore(nl);
-	sumsquare_setnum(sq, pos - 1, 0);
-	numtypes[pos - 1] = MAGSQ_EMPTYPOS;
-	sortednlist_restore(pl);
-}
-
-/** Finds and returns the next available number for the given position, being
- * zero if there is not an available number for that position, and writes it in
- * the square updating the list of available numbers and positions. */
-int magicsquare_setnext(sumsquare sq, sortednlist nl, sortednlist pl,
-			char *numtypes, int pos) {
-	int oldnum, num;
-	if (numtypes[pos - 1] == MAGSQ_DERIVEDNUM) {
-		magicsquare_removederivednum(sq, nl, pl, numtypes, pos);
+	mem += MAGSQ_ONEHOLESBYTES(side);
+	ms->stats.depthnodes = (unsigned long long *) mem;
+	ms->stats.posnodes = ms->stats.depthnodes + side * side + 1;
+	memset(mem, 0, (side * side + side * side + 1)
+			* sizeof(unsigned long long));
+	memset(ms->stats.prunes, 0, sizeof(ms->stats.prunes));
+	ms->stats.nderived = 0;
+	mem += MAGSQ_ALIGNED((side * side + side * side + 1)
+			* sizeof(unsigned long long));
+	magicsquare_initsnapshot(&ms->snapshot, mem, side * side);
+	mem += MAGSQ_ALIGNED((side * side + side * side + 1)
+			* sizeof(atomic_ullong));
+	ms->out = sumsquare_writer_init(mem, side, MAGSQ_OUTPUTBYTES,
+			STDOUT_FILENO, FIXEDWIDTH_BASE,
+			sumsquare_fixedwidth(ms->sq, FIXEDWIDTH_BASE));
+	mem += MAGSQ_ALIGNED(SUMSQUARE_WRITER_BYTES(side, MAGSQ_OUTPUTBYTES));
+	ms->numtypes = mem;
+	magicsquare_initnumtypes(ms->numtypes, side * side);
+	ms->splits = mem + side * side;
+	magicsquare_initnumtypes(ms->splits, side * side);
+	magicsquare_initpositionsorder(ms->pl, side);
+	ms->filterlevel = filterlevel;
+	ms->printstyle = printstyle;
+	ms->fillderived = fillderived;
+	ms->dynamicorder = 0;
+	ms->linepairs = 0;
+	ms->tailcells = 0;
+	ms->usednums = 0;
+	ms->sets = NULL;
+	ms->side = side;
+	ms->msum = (side * ((side * side) + 1)) / 2;
+	ms->pos = sortednlist_first(ms->pl);
+	ms->ntried = 0;
+	ms->cutdepth = 0;
+	ms->shard = 0;
+	ms->nshards = 1;
+	ms->base = 0;
+	ms->id = 0;
+	ms->cricount = 0;
+	ms->round = 0;
+	ms->nsetnext = 0;
+	ms->unit = 0;
+	ms->myunit = 0;
+	ms->nextunit = NULL;
+	atomic_init(&ms->stealreq, MAGSQ_NOREQUEST);
+	atomic_init(&ms->taskstatus, MAGSQ_NOTASK);
+	atomic_init(&ms->progress, MAGSQ_PROGRESSSCALE);
+	atomic_init(&ms->progresssquares, 0);
+	atomic_init(&ms->progressnodes, 0);
+	ms->pool = NULL;
+	ms->ckfile = NULL;
+	ms->ckinterval = 0;
+	return ms;
+}
+
+/** Makes the state search only the subtrees found after trying cutdepth numbers
+ * that it claims from the given counter, shared with the other states, and that
+ * belong to the given shard of the nshards that split the whole search. */
+void magicsquare_setcut(magicsquare ms, int cutdepth, atomic_ulong *nextunit,
+			int shard, int nshards) {
+	ms->cutdepth = cutdepth;
+	ms->shard = shard;
+	ms->nshards = nshards;
+	ms->nextunit = nextunit;
+	ms->myunit = atomic_fetch_add(nextunit, 1);
+}
+
+/** Returns if the current unit of work must be searched by the given state,
+ * claiming a new unit from the shared counter when it does, and counting it
+ * in any case, since all the states find the same units in the same order.
+ * The units are given in turn to each shard, that numbers its own units. */
+char magicsquare_claimunit(magicsquare ms) {
+	unsigned long unit = ms->unit++;
+	if (unit % ms->nshards != (unsigned long) ms->shard
+			|| unit / ms->nshards != ms->myunit) {
 		return 0;
 	}
-	oldnum = sumsquare_getnum(sq, pos - 1);
-	if (oldnum) {
-		assert(oldnum == sortednlist_lastremoved(nl));
-		sortednlist_restore(nl);
+	ms->myunit = atomic_fetch_add(ms->nextunit, 1);
+	return 1;
+}
+
+/* returns the bit of the given number in the mask of used numbers, that is
+ * only read with the sets of the lines, so only for 64 numbers or less */
+#define MAGSQ_NUMBIT(n) (1ULL << (((n) - 1) & 63))
+
+/** Removes the given number from the list of available numbers, updating with
+ * INCREMENTAL_CHECKS the sums of the first and last available numbers. */
+void magicsquare_removenum(magicsquare ms, int num) {
+	sortednlist_remove(ms->nl, num);
+	ms->usednums |= MAGSQ_NUMBIT(num);
+#if INCREMENTAL_CHECKS
+	sortednlistsums_remove(ms->sm, ms->nl, num);
+#endif
+}
+
+/** Restores the last number removed from the list of available numbers. */
+void magicsquare_restorenum(magicsquare ms) {
+	ms->usednums &= ~MAGSQ_NUMBIT(sortednlist_lastremoved(ms->nl));
+	sortednlist_restore(ms->nl);
+#if INCREMENTAL_CHECKS
+	sortednlistsums_restore(ms->sm);
+#endif
+}
+
+/** Writes the given number in the given position as the search would do it,
+ * being type the MAGSQ_TRIEDNUM or MAGSQ_DERIVEDNUM that the number had. */
+void magicsquare_push(magicsquare ms, int pos, int num, char type) {
+#if INCREMENTAL_CHECKS
+	int l, nlines = sumsquare_nlines(ms->sq);
+	unsigned long long oneholes = 0;
+#endif
+	assert(! sortednlist_isremoved(ms->nl, num));
+	assert(! sortednlist_isremoved(ms->pl, pos));
+	magicsquare_removenum(ms, num);
+	sumsquare_setnum(ms->sq, pos - 1, num);
+	ms->numtypes[pos - 1] = type;
+	sortednlist_remove(ms->pl, pos);
+	if (type == MAGSQ_TRIEDNUM) {
+		ms->ntried++;
 	}
-	num = sortednlist_next(nl, oldnum);
-	if (num) {
-		sortednlist_remove(nl, num);
-		if (! oldnum) {
-			assert(numtypes[pos - 1] == MAGSQ_EMPTYPOS);
-			assert(! sortednlist_isremoved(pl, pos));
-			sortednlist_remove(pl, pos);
-			numtypes[pos - 1] = MAGSQ_TRIEDNUM;
+#if INCREMENTAL_CHECKS
+	for (l = 0; l < nlines; l++) {
+		if (sumsquare_getlinecount(ms->sq, l).holes == 1) {
+			oneholes |= MAGSQ_LINEBIT(l);
 		}
-	} else if (oldnum) {
-		assert(numtypes[pos - 1] == MAGSQ_TRIEDNUM);
-		assert(pos == sortednlist_lastremoved(pl));
-		sortednlist_restore(pl);
-		numtypes[pos - 1] = MAGSQ_EMPTYPOS;
 	}
-	sumsquare_setnum(sq, pos - 1, num);
-	return num;
+	ms->oneholes[sortednlist_nremoved(ms->pl)] = oneholes;
+#endif
 }
 
-void magicsquare_generate(char filterlevel, char printstyle, char fillderived) {
-	unsigned long cricount = 0;
-	int pos, msum, auxpos, ln1hole;
-	char sqmem[SUMSQUARE_BYTES(N)];
-	sumsquare sq = sumsquare_init(sqmem, N);
-	char plmem[SORTEDNLIST_BYTES(N * N)];
-	sortednlist pl = sortednlist_init(plmem, N * N);
-	char nlmem[SORTEDNLIST_BYTES(N * N)];
-	sortednlist nl = sortednlist_init(nlmem, N * N);
-	char smmem[SORTEDNLISTSUMS_BYTES(N)];
-	sortednlistsums sm = sortednlistsums_init(smmem, N);
-	unsigned char fixedwidth = sumsquare_fixedwidth(sq, FIXEDWIDTH_BASE);
-	char numtypes[N * N];
-	magicsquare_initnumtypes(numtypes, N * N);
-	magicsquare_initpositionsorder(pl, N);
-	pos = sortednlist_first(pl);
-	msum = (N * ((N * N) + 1)) / 2;
-	while (1) {
-		if (magicsquare_setnext(sq, nl, pl, numtypes, pos)) {
-			while (magicsquare_checksums(sq, nl, sm, msum, &ln1hole)
-				&& magicsquare_checkequiv(sq, filterlevel)) {
-				auxpos = sortednlist_first(pl);
-				if (auxpos == 0) {
-					cricount++;
-					if (printstyle == 1) {
-						sumsquare_printreduced(sq, 1,
-						FIXEDWIDTH_BASE, fixedwidth);
-					} else if (printstyle == 2) {
-						sumsquare_printreduced(sq, 0,
-						FIXEDWIDTH_BASE, fixedwidth);
-					} else if (printstyle == 3) {
-						sumsquare_printline(sq);
-					} else if (printstyle == 4) {
-						sumsquare_print(sq);
-					}
-					break;
-				} else if (fillderived && ln1hole > -1) {
-					pos = sumsquare_emptycell(sq,ln1hole)+1;
-					magicsquare_insertderivednum(sq, nl, pl,
-								numtypes, pos,
-				msum - sumsquare_getlinecount(sq, ln1hole).sum);
-				} else {
-					pos = auxpos;
-					break;
+/** Removes the number of the last position written, of any type. */
+void magicsquare_pop(magicsquare ms) {
+	int pos = sortednlist_lastremoved(ms->pl);
+	assert(sortednlist_lastremoved(ms->nl)
+		== sumsquare_getnum(ms->sq, pos - 1));
+	if (ms->numtypes[pos - 1] == MAGSQ_TRIEDNUM) {
+		ms->ntried--;
+	}
+	magicsquare_restorenum(ms);
+	sumsquare_setnum(ms->sq, pos - 1, 0);
+	ms->numtypes[pos - 1] = MAGSQ_EMPTYPOS;
+	sortednlist_restore(ms->pl);
+}
+
+/** Removes all the numbers of the square, including the fixed ones. */
+void magicsquare_unwind(magicsquare ms) {
+	while (sortednlist_nremoved(ms->pl)) {
+		ms->splits[sortednlist_nremoved(ms->pl) - 1] = 0;
+		magicsquare_pop(ms);
+	}
+	ms->base = 0;
+}
+
+/** Writes the given square with the given writer in the given print style. */
+void magicsquare_print(sumsquare_writer w, sumsquare sq, char printstyle) {
+	if (printstyle == 1) {
+		sumsquare_writereduced(w, sq, 1);
+	} else if (printstyle == 2) {
+		sumsquare_writereduced(w, sq, 0);
+	} else if (printstyle == 3) {
+		sumsquare_writeline(w, sq);
+	} else if (printstyle == 4) {
+		sumsquare_write(w, sq);
+	} else if (printstyle == 5) {
+		sumsquare_writebinary(w, sq, 1);
+	} else if (printstyle == 6) {
+		sumsquare_writebinary(w, sq, 0);
+	}
+}
+
+/** Writes at once the header of the file for the binary print styles. */
+void magicsquare_printheader(sumsquare_writer w, char printstyle,
+				char filterlevel) {
+	if (printstyle == 5 || printstyle == 6) {
+		sumsquare_writeheader(w, filterlevel, printstyle == 5);
+		sumsquare_writer_flush(w);
+	}
+}
+
+/** Counts the complete magic square of the state and writes it in its style to
+ * the buffer of the state, that is written when full or at the end. */
+void magicsquare_found(magicsquare ms) {
+	ms->cricount++;
+	magicsquare_print(ms->out, ms->sq, ms->printstyle);
+}
+
+/** Restores the last positions whose remaining numbers were given to another
+ * state and returns the last position not restored to continue the search,
+ * or 0 when the search ends because there are only fixed positions. */
+int magicsquare_backtrack(magicsquare ms) {
+	sortednlist pl = ms->pl;
+	int idx;
+	while ((idx = sortednlist_nremoved(pl)) > ms->base) {
+		if (! ms->splits[idx - 1]) {
+			return sortednlist_lastremoved(pl);
+		}
+		ms->splits[idx - 1] = 0;
+		magicsquare_pop(ms);
+	}
+	return 0;
+}
+
+/** Returns the index in the stack of positions of the first tried number that
+ * can be given to other state and has bigger numbers not tried yet, or -1 if
+ * there is none. Only the subtrees claimed after the cut depth can be given,
+ * and not the position of the given pos that is being currently tried. */
+int magicsquare_splitindex(magicsquare ms, int pos) {
+	sortednlist nl = ms->nl, pl = ms->pl;
+	int i, n, num, ntried = 0, top = sortednlist_nremoved(pl);
+	char used[256] = {0};
+	if (sortednlist_isremoved(pl, pos)) {
+		top--;
+	}
+	for (i = 0; i < top; i++) {
+		num = sortednlist_removed(nl, i);
+		if (ms->numtypes[sortednlist_removed(pl, i) - 1]
+				== MAGSQ_TRIEDNUM && ++ntried > ms->cutdepth
+				&& i >= ms->base && ! ms->splits[i]) {
+			for (n = num + 1; n <= sortednlist_size(nl); n++) {
+				if (! used[n]) {
+					return i;
 				}
 			}
-		} else if (sortednlist_nremoved(pl) == 0) {
-			break;
+		}
+		used[num] = 1;
+	}
+	return -1;
+}
+
+/** Answers the request of the idle state that wants to steal work from the
+ * given state, copying to it the numbers of the first positions until the
+ * first one with numbers not tried yet, that will be tried by the idle state
+ * instead of this one. Another request is accepted only after answering. */
+void magicsquare_givework(magicsquare ms, int pos) {
+	int i, idx, p;
+	magicsquare thief = ms->pool->states[atomic_load_explicit(&ms->stealreq,
+					memory_order_acquire) - 1];
+	idx = magicsquare_splitindex(ms, pos);
+	if (idx < 0) {
+		atomic_store_explicit(&thief->taskstatus, MAGSQ_NOTASK,
+					memory_order_release);
+	} else {
+		ms->splits[idx] = 1;
+		for (i = 0; i <= idx; i++) {
+			p = sortednlist_removed(ms->pl, i);
+			magicsquare_push(thief, p,
+					sortednlist_removed(ms->nl, i),
+					ms->numtypes[p - 1]);
+		}
+		thief->base = idx;
+		thief->pos = sortednlist_removed(ms->pl, idx);
+		thief->cutdepth = 0;
+		atomic_fetch_sub(&ms->pool->nidle, 1);
+		atomic_store_explicit(&thief->taskstatus, MAGSQ_GOTTASK,
+					memory_order_release);
+	}
+	atomic_store_explicit(&ms->stealreq, MAGSQ_NOREQUEST,
+				memory_order_release);
+}
+
+static volatile sig_atomic_t magicsquare_signaled = 0;
+static volatile sig_atomic_t magicsquare_alarmed = 0;
+static volatile sig_atomic_t magicsquare_terminated = 0;
+static volatile sig_atomic_t magicsquare_statsrequested = 0;
+static volatile sig_atomic_t magicsquare_progressrequested = 0;
+
+/** Saves the signals received to handle them between two tries of numbers. */
+static void magicsquare_onsignal(int sig) {
+	if (sig == SIGALRM) {
+		magicsquare_alarmed = 1;
+	} else if (sig == SIGTERM) {
+		magicsquare_terminated = 1;
+	} else if (sig == SIGUSR1) {
+		magicsquare_statsrequested = 1;
+	} else if (sig == SIGUSR2) {
+		magicsquare_progressrequested = 1;
+	}
+	magicsquare_signaled = 1;
+}
+
+/** Makes the given signal be saved by magicsquare_onsignal. */
+void magicsquare_catchsignal(int sig) {
+	struct sigaction sa;
+	sa.sa_handler = magicsquare_onsignal;
+	sigemptyset(&sa.sa_mask);
+	sa.sa_flags = SA_RESTART;
+	sigaction(sig, &sa, NULL);
+}
+
+/* prints to the standard error the given statistics of the given side */
+static void magicsquare_printstatsof(const char *title, int side,
+			unsigned long cricount, const magicsquare_stats *st) {
+	unsigned long long nnodes = 0;
+	int k, ncells = side * side;
+	for (k = 1; k <= ncells; k++) {
+		nnodes += st->depthnodes[k];
+	}
+	fprintf(stderr, "%s: %lu squares, %llu nodes, %llu derived\n"
+		"  discarded:", title, cricount, nnodes, st->nderived);
+	for (k = 0; k < MAGSQ_NREASONS; k++) {
+		fprintf(stderr, " %s=%llu", magicsquare_reasons[k],
+			st->prunes[k]);
+	}
+	fprintf(stderr, "\n  nodes by depth:");
+	for (k = 1; k <= ncells; k++) {
+		fprintf(stderr, " %llu", st->depthnodes[k]);
+	}
+	fprintf(stderr, "\n  nodes by position:");
+	for (k = 0; k < ncells; k++) {
+		fprintf(stderr, "%s %llu", k % side ? "" : "\n   ",
+			st->posnodes[k]);
+	}
+	fprintf(stderr, "\n");
+}
+
+/** Publishes from the thread that searches with the given state the snapshot
+ * of its statistics and its count of squares, that any thread can read. */
+void magicsquare_publishstats(magicsquare ms) {
+	magicsquare_snapshot *s = &ms->snapshot;
+	int k, ncells = sumsquare_ncells(ms->sq);
+	atomic_store_explicit(&s->cricount, ms->cricount,
+				memory_order_relaxed);
+	atomic_store_explicit(&s->nderived, ms->stats.nderived,
+				memory_order_relaxed);
+	for (k = 0; k < MAGSQ_NREASONS; k++) {
+		atomic_store_explicit(s->prunes + k, ms->stats.prunes[k],
+					memory_order_relaxed);
+	}
+	for (k = 0; k <= ncells; k++) {
+		atomic_store_explicit(s->depthnodes + k,
+			ms->stats.depthnodes[k], memory_order_relaxed);
+	}
+	for (k = 0; k < ncells; k++) {
+		atomic_store_explicit(s->posnodes + k, ms->stats.posnodes[k],
+					memory_order_relaxed);
+	}
+}
+
+/* copies the given snapshot of ncells cells to the given statistics, whose
+ * arrays must have room for them, and returns its count of squares */
+static unsigned long magicsquare_readsnapshot(magicsquare_snapshot *s,
+					magicsquare_stats *st, int ncells) {
+	int k;
+	st->nderived = atomic_load_explicit(&s->nderived,
+						memory_order_relaxed);
+	for (k = 0; k < MAGSQ_NREASONS; k++) {
+		st->prunes[k] = atomic_load_explicit(s->prunes + k,
+						memory_order_relaxed);
+	}
+	for (k = 0; k <= ncells; k++) {
+		st->depthnodes[k] = atomic_load_explicit(s->depthnodes + k,
+						memory_order_relaxed);
+	}
+	for (k = 0; k < ncells; k++) {
+		st->posnodes[k] = atomic_load_explicit(s->posnodes + k,
+						memory_order_relaxed);
+	}
+	return atomic_load_explicit(&s->cricount, memory_order_relaxed);
+}
+
+/** Prints to the standard error the statistics of each one of the given states
+ * and their totals when there are more than one. With published, the states
+ * can be searching in other threads and the snapshots published by them are
+ * printed instead, otherwise their threads must have ended. */
+void magicsquare_printstats(magicsquare *states, int nstates,
+				char published) {
+	unsigned long long depthnodes[MAGSQ_MAXSIDE * MAGSQ_MAXSIDE + 1] = {0};
+	unsigned long long posnodes[MAGSQ_MAXSIDE * MAGSQ_MAXSIDE] = {0};
+	unsigned long long snapdepth[MAGSQ_MAXSIDE * MAGSQ_MAXSIDE + 1];
+	unsigned long long snappos[MAGSQ_MAXSIDE * MAGSQ_MAXSIDE];
+	magicsquare_stats total = {0, {0}, depthnodes, posnodes};
+	magicsquare_stats snap = {0, {0}, snapdepth, snappos};
+	const magicsquare_stats *st;
+	unsigned long cricount = 0, count;
+	int t, k, side = states[0]->side;
+	char title[32];
+	for (t = 0; t < nstates; t++) {
+		if (published) {
+			count = magicsquare_readsnapshot(&states[t]->snapshot,
+							&snap, side * side);
+			st = &snap;
 		} else {
-			pos = sortednlist_lastremoved(pl);
+			count = states[t]->cricount;
+			st = &states[t]->stats;
+		}
+		snprintf(title, sizeof(title), "Thread %d", t);
+		magicsquare_printstatsof(title, side, count, st);
+		cricount += count;
+		total.nderived += st->nderived;
+		for (k = 0; k < MAGSQ_NREASONS; k++) {
+			total.prunes[k] += st->prunes[k];
+		}
+		for (k = 0; k < side * side; k++) {
+			depthnodes[k + 1] += st->depthnodes[k + 1];
+			posnodes[k] += st->posnodes[k];
 		}
 	}
-	if (printstyle == 0) {
-		printf("%lu\n", cricount);
+	if (nstates > 1) {
+		magicsquare_printstatsof("Total", side, cricount, &total);
+	}
+}
+
+/* returns the seconds of a monotonic clock */
+static double magicsquare_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* number of the first tried positions of the stack that give the progress */
+#define MAGSQ_PROGRESSDEPTH 6
+
+/* start of the search and its fraction done then, to estimate its end */
+static double magicsquare_progressstart = 0;
+static double magicsquare_startfraction = 0;
+
+/** Returns the fraction of the search tree before the current numbers of the
+ * first tried positions of the stack of the state, adding for each one the
+ * part of the subtree of the previous positions that belongs to the available
+ * numbers less than its number, as if the subtrees of all of them were equal.
+ * It must be called from the thread that searches with the state. */
+double magicsquare_fraction(magicsquare ms) {
+	sumsquare sq = ms->sq;
+	sortednlist pl = ms->pl;
+	int idx, k, pos, num, nless, ntried = 0, ncells = sumsquare_ncells(sq);
+	int nremoved = sortednlist_nremoved(pl);
+	double fraction = 0, width = 1;
+	for (idx = 0; idx < nremoved && ntried < MAGSQ_PROGRESSDEPTH; idx++) {
+		pos = sortednlist_removed(pl, idx);
+		if (ms->numtypes[pos - 1] != MAGSQ_TRIEDNUM) {
+			continue;
+		}
+		num = sumsquare_getnum(sq, pos - 1);
+		for (k = 0, nless = 0; k < idx; k++) {
+			nless += sumsquare_getnum(sq,
+				sortednlist_removed(pl, k) - 1) < num;
+		}
+		width /= ncells - idx;
+		fraction += width * (num - 1 - nless);
+		ntried++;
+	}
+	return fraction < 0 ? 0 : fraction > 1 ? 1 : fraction;
+}
+
+/** Publishes from the thread that searches with the given state the fraction
+ * of its search done, the whole search when it has no numbers, its squares
+ * and its nodes, so magicsquare_printprogress can read them from any thread
+ * when the progress is requested. */
+void magicsquare_publishprogress(magicsquare ms) {
+	unsigned long long nnodes = 0;
+	int k, ncells = sumsquare_ncells(ms->sq);
+	double fraction = sortednlist_nremoved(ms->pl)
+		? magicsquare_fraction(ms) : 1;
+	for (k = 1; k <= ncells; k++) {
+		nnodes += ms->stats.depthnodes[k];
+	}
+	atomic_store_explicit(&ms->progress,
+		(unsigned long) (fraction * MAGSQ_PROGRESSSCALE),
+		memory_order_relaxed);
+	atomic_store_explicit(&ms->progresssquares, ms->cricount,
+				memory_order_relaxed);
+	atomic_store_explicit(&ms->progressnodes, nnodes,
+				memory_order_relaxed);
+}
+
+/* writes the given seconds as hours, minutes and seconds */
+static void magicsquare_formatsecs(char *text, size_t len, double secs) {
+	unsigned long s = secs;
+	snprintf(text, len, "%luh%02lum%02lus", s / 3600, s / 60 % 60, s % 60);
+}
+
+/** Prints to the standard error the progress of the search of the given
+ * states as published by each one: the fraction of the tree done, being the
+ * least one of the states, the squares found, the nodes per second and the
+ * time remaining, estimated from the fraction done since the start of the
+ * search. */
+void magicsquare_printprogress(magicsquare *states, int nstates) {
+	unsigned long long nnodes = 0;
+	unsigned long cricount = 0, progress = MAGSQ_PROGRESSSCALE, p;
+	int t;
+	double fraction, elapsed, done;
+	char elapsedtext[32], etatext[32];
+	for (t = 0; t < nstates; t++) {
+		cricount += atomic_load_explicit(&states[t]->progresssquares,
+						memory_order_relaxed);
+		nnodes += atomic_load_explicit(&states[t]->progressnodes,
+						memory_order_relaxed);
+		p = atomic_load_explicit(&states[t]->progress,
+					memory_order_relaxed);
+		progress = p < progress ? p : progress;
+	}
+	fraction = (double) progress / MAGSQ_PROGRESSSCALE;
+	elapsed = magicsquare_now() - magicsquare_progressstart;
+	done = fraction - magicsquare_startfraction;
+	magicsquare_formatsecs(elapsedtext, sizeof(elapsedtext), elapsed);
+	if (done > 0) {
+		magicsquare_formatsecs(etatext, sizeof(etatext),
+					elapsed * (1 - fraction) / done);
+	} else {
+		snprintf(etatext, sizeof(etatext), "unknown");
+	}
+	fprintf(stderr, "Progress: %.4f%%, %lu squares, %.3g nodes/s, "
+		"elapsed %s, ETA %s\n", 100 * fraction, cricount,
+		elapsed > 0 ? nnodes / elapsed : 0, elapsedtext, etatext);
+}
+
+/* sends SIGUSR2 to the process every given seconds to print the progress */
+static void *magicsquare_progresstimer(void *interval) {
+	struct timespec ts = {*(int *) interval, 0};
+	while (1) {
+		nanosleep(&ts, NULL);
+		kill(getpid(), SIGUSR2);
+	}
+	return NULL;
+}
+
+#define MAGSQ_CHECKPOINT_HEADER "magicsquare-checkpoint 3"
+
+/** Writes in the given file the state of the search to continue it later,
+ * saving the numbers of the stack of positions with their types, the position
+ * to try, the count of squares and the offset of the output after writing the
+ * squares of the buffer. The file is replaced only when the new one is
+ * complete. */
+char magicsquare_savecheckpoint(magicsquare ms, const char *filename) {
+	char tmpname[FILENAME_MAX];
+	FILE *f;
+	int i, p, nremoved = sortednlist_nremoved(ms->pl);
+	sumsquare_writer_flush(ms->out);
+	snprintf(tmpname, sizeof(tmpname), "%s.tmp", filename);
+	f = fopen(tmpname, "w");
+	if (f == NULL) {
+		perror(tmpname);
+		return 0;
+	}
+	fprintf(f, "%s\n%d %d %d %d %d %d %d %d %d\n%lu %lu %lu %lld\n%d %d\n",
+		MAGSQ_CHECKPOINT_HEADER, ms->side, sumsquare_lines(ms->sq),
+		ms->filterlevel, ms->printstyle, ms->fillderived,
+		ms->dynamicorder, ms->cutdepth, ms->shard, ms->nshards,
+		ms->cricount, ms->unit, ms->myunit,
+		(long long) lseek(ms->out->fd, 0, SEEK_CUR), ms->pos, nremoved);
+	for (i = 0; i < nremoved; i++) {
+		p = sortednlist_removed(ms->pl, i);
+		fprintf(f, "%d %d %d\n", p, sortednlist_removed(ms->nl, i),
+			ms->numtypes[p - 1]);
+	}
+	if (fclose(f) || rename(tmpname, filename)) {
+		perror(filename);
+		return 0;
+	}
+	return 1;
+}
+
+/** Reads from the given file the state of a search saved with the same options
+ * to the given initialized state, returning 0 if it cannot be read. When the
+ * output is a file with more bytes than the saved offset, it is truncated to
+ * remove the squares printed after the checkpoint. */
+char magicsquare_loadcheckpoint(magicsquare ms, const char *filename) {
+	char header[sizeof(MAGSQ_CHECKPOINT_HEADER)];
+	int i, side, lines, filterlevel, printstyle, fillderived, dynamicorder;
+	int cutdepth, shard, nshards;
+	int pos, nremoved, p, num, type, ncells = ms->side * ms->side;
+	long long offset;
+	struct stat st;
+	FILE *f = fopen(filename, "r");
+	if (f == NULL) {
+		perror(filename);
+		return 0;
+	}
+	if (fscanf(f, "%24[^\n] %d %d %d %d %d %d %d %d %d"
+			" %lu %lu %lu %lld %d %d",
+			header, &side, &lines, &filterlevel, &printstyle,
+			&fillderived, &dynamicorder, &cutdepth, &shard,
+			&nshards, &ms->cricount, &ms->unit, &ms->myunit,
+			&offset, &pos, &nremoved) != 16
+			|| strcmp(header, MAGSQ_CHECKPOINT_HEADER)
+			|| side != ms->side || lines != sumsquare_lines(ms->sq)
+			|| filterlevel != ms->filterlevel
+			|| printstyle != ms->printstyle
+			|| fillderived != ms->fillderived
+			|| dynamicorder != ms->dynamicorder
+			|| cutdepth != ms->cutdepth
+			|| shard != ms->shard || nshards != ms->nshards
+			|| pos < 1 || pos > ncells
+			|| nremoved < 0 || nremoved > ncells) {
+		fprintf(stderr, "%s: not a checkpoint of this search\n",
+			filename);
+		fclose(f);
+		return 0;
+	}
+	for (i = 0; i < nremoved; i++) {
+		if (fscanf(f, "%d %d %d", &p, &num, &type) != 3
+				|| p < 1 || p > ncells
+				|| num < 1 || num > ncells
+				|| sortednlist_isremoved(ms->pl, p)
+				|| sortednlist_isremoved(ms->nl, num)
+				|| (type != MAGSQ_TRIEDNUM
+					&& type != MAGSQ_DERIVEDNUM)) {
+			fprintf(stderr, "%s: invalid position %d\n", filename,
+				i + 1);
+			fclose(f);
+			return 0;
+		}
+		magicsquare_push(ms, p, num, type);
+	}
+	fclose(f);
+	ms->pos = pos;
+	if (offset >= 0 && fstat(ms->out->fd, &st) == 0
+			&& S_ISREG(st.st_mode) && st.st_size > offset) {
+		if (ftruncate(ms->out->fd, offset)
+				|| lseek(ms->out->fd, offset, SEEK_SET) < 0) {
+			perror("Cannot truncate the output");
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/* kinds of the reports requested by the signals, as bits */
+#define MAGSQ_STATSREPORT 1
+#define MAGSQ_PROGRESSREPORT 2
+
+/** Takes part in the reports requested by the signals from the thread of the
+ * given state of a pool: starts a round of snapshots when a report is
+ * requested and the previous round ended, publishes the snapshot of the state
+ * once in each round and, being the last state of the round to publish it,
+ * prints the reports from the snapshots of all the states. Meanwhile it keeps
+ * magicsquare_signaled set, so the other states take part too, searching or
+ * stealing work, and no state reads the counters of the others. */
+void magicsquare_answerreports(magicsquare ms) {
+	magicsquare_pool pool = ms->pool;
+	int npending = 0, reports;
+	unsigned int round;
+	if ((magicsquare_statsrequested || magicsquare_progressrequested)
+		&& atomic_compare_exchange_strong(&pool->npending, &npending,
+							pool->nstates + 1)) {
+		reports = 0;
+		if (magicsquare_statsrequested) {
+			magicsquare_statsrequested = 0;
+			reports |= MAGSQ_STATSREPORT;
+		}
+		if (magicsquare_progressrequested) {
+			magicsquare_progressrequested = 0;
+			reports |= MAGSQ_PROGRESSREPORT;
+		}
+		atomic_store(&pool->reports, reports);
+		atomic_fetch_add(&pool->round, 1);
+	}
+	round = atomic_load(&pool->round);
+	if (ms->round != round) {
+		ms->round = round;
+		magicsquare_publishstats(ms);
+		magicsquare_publishprogress(ms);
+		if (atomic_fetch_sub(&pool->npending, 1) == 2) {
+			reports = atomic_load(&pool->reports);
+			if (reports & MAGSQ_STATSREPORT) {
+				magicsquare_printstats(pool->states,
+							pool->nstates, 1);
+			}
+			if (reports & MAGSQ_PROGRESSREPORT) {
+				magicsquare_printprogress(pool->states,
+							pool->nstates);
+			}
+			atomic_store(&pool->npending, 0);
+		}
+	}
+	if (atomic_load(&pool->npending) || magicsquare_statsrequested
+			|| magicsquare_progressrequested) {
+		magicsquare_signaled = 1;
 	}
 }
 
-int main(void) {
-	magicsquare_generate(FILTER_LEVEL, PRINT_STYLE, FILL_DERIVED);
+/** Handles the signals received while searching, printing the statistics or
+ * the progress of all the states when requested, saving a checkpoint when the
+ * alarm rings or when the process is terminated, and returns 0 in this
+ * case. */
+char magicsquare_handlesignals(magicsquare ms, int pos) {
+	char terminated = magicsquare_terminated;
+	magicsquare_signaled = 0;
+	if (ms->pool) {
+		magicsquare_answerreports(ms);
+	} else {
+		if (magicsquare_statsrequested) {
+			magicsquare_statsrequested = 0;
+			magicsquare_printstats(&ms, 1, 0);
+		}
+		if (magicsquare_progressrequested) {
+			magicsquare_progressrequested = 0;
+			magicsquare_publishprogress(ms);
+			magicsquare_printprogress(&ms, 1);
+		}
+	}
+	if (magicsquare_alarmed || terminated) {
+		magicsquare_alarmed = 0;
+		ms->pos = pos;
+		if (ms->ckfile) {
+			magicsquare_savecheckpoint(ms, ms->ckfile);
+		}
+		if (! terminated) {
+			alarm(ms->ckinterval);
+		}
+	}
+	return ! terminated;
+}
+
+/* returns of MAGSQ_K(expand) when the numbers written fail the checks */
+#define MAGSQ_FAILED (-1)
+#define MAGSQ_DERIVEDFAILED (-2)
+
+/* the seconds of each node are measured following random paths from the first
+ * position until writing MAGSQ_CALIBRATIONTOTAL nodes */
+#define MAGSQ_CALIBRATIONTOTAL 1000000
+
+/** Returns a pseudo-random number from 0 to n - 1 with the xorshift64*
+ * generator of the given state, that must not be 0. */
+static unsigned long magicsquare_random(unsigned long long *rng,
+					unsigned long n) {
+	*rng ^= *rng >> 12;
+	*rng ^= *rng << 25;
+	*rng ^= *rng >> 27;
+	return ((*rng * 2685821657736338717ULL) >> 32) % n;
+}
+
+#define MAGSQ_KSIDE 3
+#include "magicsquaresearch.c"
+#define MAGSQ_KSIDE 4
+#include "magicsquaresearch.c"
+#define MAGSQ_KSIDE 5
+#include "magicsquaresearch.c"
+#define MAGSQ_KSIDE 6
+#include "magicsquaresearch.c"
+#define MAGSQ_KSIDE 7
+#include "magicsquaresearch.c"
+#define MAGSQ_KSIDE 8
+#include "magicsquaresearch.c"
+#include "magicsquaresearch.c"
+
+/** Searches with the functions specialized for the side of the state, or with
+ * the functions for any side when there are not specialized ones or when the
+ * square has other lines than the ones of the magic squares. */
+char magicsquare_search(magicsquare ms) {
+	switch (sumsquare_lines(ms->sq) == SUMSQ_MAGICLINES ? ms->side : 0) {
+	case 3:
+		return magicsquare_search_3(ms);
+	case 4:
+		return magicsquare_search_4(ms);
+	case 5:
+		return magicsquare_search_5(ms);
+	case 6:
+		return magicsquare_search_6(ms);
+	case 7:
+		return magicsquare_search_7(ms);
+	case 8:
+		return magicsquare_search_8(ms);
+	}
+	return magicsquare_search_any(ms);
+}
+
+/** Makes the given state, that ended its search, steal the work not yet done
+ * by the other states of its pool, returning 0 when all of them are idle. */
+char magicsquare_steal(magicsquare ms) {
+	magicsquare_pool pool = ms->pool;
+	magicsquare victim;
+	int v, req, nfailed = 0;
+	struct timespec backoff = {0, 100000};
+	magicsquare_unwind(ms);
+	req = MAGSQ_NOREQUEST;
+	if (! atomic_compare_exchange_strong(&ms->stealreq, &req,
+						MAGSQ_CLOSED)) {
+		atomic_store(&pool->states[req - 1]->taskstatus, MAGSQ_NOTASK);
+		atomic_store(&ms->stealreq, MAGSQ_CLOSED);
+	}
+	atomic_fetch_add(&pool->nidle, 1);
+	for (v = ms->id + 1; atomic_load(&pool->nidle) < pool->nstates; v++) {
+		if (magicsquare_signaled) {
+			magicsquare_answerreports(ms);
+		}
+		victim = pool->states[v % pool->nstates];
+		req = MAGSQ_NOREQUEST;
+		if (victim != ms) {
+			atomic_store(&ms->taskstatus, MAGSQ_WAITING);
+			if (atomic_compare_exchange_strong(&victim->stealreq,
+						&req, ms->id + 1)) {
+				while (atomic_load(&ms->taskstatus)
+						== MAGSQ_WAITING) {
+					sched_yield();
+				}
+				if (atomic_load(&ms->taskstatus)
+						== MAGSQ_GOTTASK) {
+					atomic_store(&ms->stealreq,
+							MAGSQ_NOREQUEST);
+					return 1;
+				}
+			}
+		} else if (++nfailed > 1) {
+			nanosleep(&backoff, NULL);
+		} else {
+			sched_yield();
+		}
+	}
 	return 0;
 }
 
+/** Searches the subtrees claimed by the state and then steals the work of the
+ * other states of its pool until all of them are idle, writing at the end the
+ * squares remaining in its buffer. */
+static void *magicsquare_searchthread(void *ms) {
+	magicsquare_search((magicsquare) ms);
+	while (magicsquare_steal((magicsquare) ms)) {
+		magicsquare_search((magicsquare) ms);
+	}
+	sumsquare_writer_flush(((magicsquare) ms)->out);
+	return NULL;
+}
+
+/** Options of the generation of the magic squares. */
+typedef struct magicsquare_config_st {
+	char lines, filterlevel, printstyle, fillderived, dynamicorder;
+	char linesets, linepairs, resume, stats;
+	int side, nthreads, cutdepth, ckinterval, shard, nshards, tailcells;
+	int progress;
+	const char *ckfile;
+} magicsquare_config;
+
+/** Returns a new table of the sets of numbers of the lines of the given side,
+ * exiting if the side is not supported or if there is not enough memory. */
+sumsets magicsquare_newsets(int side) {
+	int nsets = sumsets_count(side);
+	char *mem = nsets ? malloc(SUMSETS_BYTES(side, nsets)) : NULL;
+	if (mem == NULL) {
+		fprintf(stderr, "Cannot create the sets of the lines of size "
+			"%d, only up to %d\n", side, SUMSETS_MAXSIDE);
+		exit(1);
+	}
+	return sumsets_init(mem, side, nsets);
+}
+
+/** Searches with a single state, saving checkpoints periodically and when the
+ * process is terminated if a checkpoint file is given, resuming the search
+ * saved in it if requested, and returns 0 if the search was stopped. The
+ * given table of the sets of the lines is used if it is not NULL. */
+char magicsquare_generatesingle(const magicsquare_config *cfg, sumsets sets,
+				unsigned long *pcricount) {
+	char *msmem = malloc(MAGICSQUARE_BYTES(cfg->side)), done;
+	magicsquare ms;
+	atomic_ulong nextunit;
+	if (msmem == NULL) {
+		fprintf(stderr, "Not enough memory for size %d\n", cfg->side);
+		exit(1);
+	}
+	ms = magicsquare_init(msmem, cfg->side, cfg->lines, cfg->filterlevel,
+				cfg->printstyle, cfg->fillderived);
+	ms->dynamicorder = cfg->dynamicorder;
+	ms->linepairs = cfg->linepairs;
+	ms->tailcells = cfg->printstyle ? 0 : cfg->tailcells;
+	ms->sets = sets;
+	atomic_init(&nextunit, 0);
+	if (cfg->nshards > 1) {
+		magicsquare_setcut(ms, cfg->cutdepth, &nextunit, cfg->shard,
+					cfg->nshards);
+	}
+	if (! cfg->resume) {
+		magicsquare_printheader(ms->out, cfg->printstyle,
+					cfg->filterlevel);
+	}
+	if (cfg->ckfile) {
+		if (cfg->resume
+			&& ! magicsquare_loadcheckpoint(ms, cfg->ckfile)) {
+			exit(1);
+		}
+		magicsquare_startfraction = magicsquare_fraction(ms);
+		atomic_store(&nextunit, ms->myunit + 1);
+		ms->ckfile = cfg->ckfile;
+		ms->ckinterval = cfg->ckinterval;
+		magicsquare_catchsignal(SIGALRM);
+		magicsquare_catchsignal(SIGTERM);
+		alarm(ms->ckinterval);
+	}
+	done = magicsquare_search(ms);
+	sumsquare_writer_flush(ms->out);
+	if (cfg->ckfile) {
+		alarm(0);
+		if (done) {
+			remove(cfg->ckfile);
+		} else {
+			fprintf(stderr, "Search stopped, saved in %s\n",
+				cfg->ckfile);
+		}
+	}
+	if (cfg->stats) {
+		magicsquare_printstats(&ms, 1, 0);
+	}
+	*pcricount = ms->cricount;
+	free(msmem);
+	return done;
+}
+
+/** Generates the magic squares with the given options, splitting the search
+ * between the given number of threads when it is more than one, each one
+ * claiming the subtrees found after trying the first cutdepth numbers and
+ * then stealing the numbers not tried yet by the threads still searching.
+ * The statistics of the search are printed when the process receives SIGUSR1
+ * and at the end if requested, and the progress when it receives SIGUSR2,
+ * sent every given seconds by a timer thread if requested.
+ * Returns 0 if the search was stopped before generating all the squares. */
+char magicsquare_generate(const magicsquare_config *cfg) {
+	unsigned long cricount = 0;
+	char *mem, done = 1;
+	magicsquare ms;
+	pthread_t *threads, timer;
+	atomic_ulong nextunit;
+	struct magicsquare_pool_st pool;
+	int t, nthreads = cfg->nthreads;
+	size_t bytes = MAGICSQUARE_BYTES(cfg->side);
+	sumsets sets = cfg->linesets ? magicsquare_newsets(cfg->side) : NULL;
+	magicsquare_catchsignal(SIGUSR1);
+	magicsquare_catchsignal(SIGUSR2);
+	magicsquare_progressstart = magicsquare_now();
+	if (cfg->progress) {
+		if (pthread_create(&timer, NULL, magicsquare_progresstimer,
+					(void *) &cfg->progress)) {
+			fprintf(stderr, "Cannot create the timer thread\n");
+			exit(1);
+		}
+		pthread_detach(timer);
+	}
+	if (nthreads < 2) {
+		done = magicsquare_generatesingle(cfg, sets, &cricount);
+	} else {
+		mem = malloc(nthreads * bytes);
+		threads = malloc(nthreads * sizeof(pthread_t));
+		pool.states = malloc(nthreads * sizeof(magicsquare));
+		if (mem == NULL || threads == NULL || pool.states == NULL) {
+			fprintf(stderr, "Not enough memory for %d threads\n",
+				nthreads);
+			exit(1);
+		}
+		atomic_init(&nextunit, 0);
+		pool.nstates = nthreads;
+		atomic_init(&pool.nidle, 0);
+		atomic_init(&pool.round, 0);
+		atomic_init(&pool.npending, 0);
+		atomic_init(&pool.reports, 0);
+		pthread_mutex_init(&pool.outlock, NULL);
+		for (t = 0; t < nthreads; t++) {
+			ms = magicsquare_init(mem + t * bytes, cfg->side,
+					cfg->lines, cfg->filterlevel,
+					cfg->printstyle, cfg->fillderived);
+			ms->dynamicorder = cfg->dynamicorder;
+			ms->linepairs = cfg->linepairs;
+			ms->tailcells = cfg->printstyle ? 0 : cfg->tailcells;
+			ms->sets = sets;
+			ms->out->lock = &pool.outlock;
+			ms->id = t;
+			ms->pool = &pool;
+			magicsquare_setcut(ms, cfg->cutdepth, &nextunit,
+						cfg->shard, cfg->nshards);
+			pool.states[t] = ms;
+		}
+		magicsquare_printheader(pool.states[0]->out, cfg->printstyle,
+					cfg->filterlevel);
+		for (t = 0; t < nthreads; t++) {
+			if (pthread_create(threads + t, NULL,
+					magicsquare_searchthread,
+					pool.states[t])) {
+				fprintf(stderr, "Cannot create thread %d\n", t);
+				exit(1);
+			}
+		}
+		for (t = 0; t < nthreads; t++) {
+			pthread_join(threads[t], NULL);
+			ms = (magicsquare) (mem + t * bytes);
+			cricount += ms->cricount;
+		}
+		if (cfg->stats) {
+			magicsquare_printstats(pool.states, nthreads, 0);
+		}
+		pthread_mutex_destroy(&pool.outlock);
+		free(pool.states);
+		free(threads);
+		free(mem);
+	}
+	if (done && cfg->printstyle == 0) {
+		printf("%lu\n", cricount);
+	}
+	free(sets);
+	return done;
+}
+
+/** Numbers of the four corners fixed in the slices of the 5x5 search measured
+ * by the benchmark, in the order of the positions: top-left, top-right,
+ * bottom-left and bottom-right. */
+static const int magicsquare_benchcorners[][4] = {
+	{1, 12, 14, 23}, {1, 5, 9, 20}, {2, 7, 9, 21}, {3, 4, 11, 25}
+};
+
+#define MAGSQ_NBENCHCORNERS ((int) (sizeof(magicsquare_benchcorners) \
+				/ sizeof(magicsquare_benchcorners[0])))
+
+/** Result of the repetitions of one workload of the benchmark. */
+typedef struct magicsquare_benchresult_st {
+	unsigned long cricount;
+	unsigned long long nsetnext, nnodes, nbytes;
+	double *seconds;
+} magicsquare_benchresult;
+
+/* returns the square root by Newton's method, to not link the math library,
+ * starting above the root and stopping when the approximations stop going
+ * down */
+static double magicsquare_sqrt(double x) {
+	double y = x > 1 ? x : 1, prev;
+	if (x <= 0) {
+		return 0;
+	}
+	do {
+		prev = y;
+		y = (y + x / y) / 2;
+	} while (y < prev);
+	return prev;
+}
+
+/* compares two doubles for qsort */
+static int magicsquare_cmpdouble(const void *d1, const void *d2) {
+	return *(const double *) d1 < *(const double *) d2 ? -1
+		: *(const double *) d1 > *(const double *) d2;
+}
+
+/** Searches the number of times of the result the squares of the given side,
+ * filter level and filling of the derived numbers, with the print style and
+ * the checks and order of the positions of the given options, fixing the given
+ * numbers of the corners if any, with a single state that writes the squares to
+ * the given descriptor, and saves in the result the seconds of each search and
+ * the counts of the last one.
+ * Returns 0 if the searches did not find the same squares. */
+char magicsquare_benchrun(const magicsquare_config *cfg, int side,
+			char filterlevel, char fillderived, const int *corners,
+			int nrepeats, int fd, magicsquare_benchresult *res) {
+	char *msmem = malloc(MAGICSQUARE_BYTES(side)), same = 1;
+	sumsets sets = cfg->linesets ? magicsquare_newsets(side) : NULL;
+	magicsquare ms;
+	int r, k;
+	double start;
+	if (msmem == NULL) {
+		fprintf(stderr, "Not enough memory for size %d\n", side);
+		exit(1);
+	}
+	for (r = 0; r < nrepeats; r++) {
+		ms = magicsquare_init(msmem, side, SUMSQ_MAGICLINES,
+				filterlevel, cfg->printstyle, fillderived);
+		ms->dynamicorder = cfg->dynamicorder;
+		ms->linepairs = cfg->linepairs;
+		ms->tailcells = cfg->printstyle ? 0 : cfg->tailcells;
+		ms->sets = sets;
+		ms->out->fd = fd;
+		for (k = 0; corners && k < 4; k++) {
+			magicsquare_push(ms, sortednlist_first(ms->pl),
+					corners[k], MAGSQ_TRIEDNUM);
+		}
+		ms->base = sortednlist_nremoved(ms->pl);
+		ms->pos = sortednlist_first(ms->pl);
+		start = magicsquare_now();
+		magicsquare_search(ms);
+		sumsquare_writer_flush(ms->out);
+		res->seconds[r] = magicsquare_now() - start;
+		if (r && (ms->cricount != res->cricount
+				|| ms->nsetnext != res->nsetnext)) {
+			same = 0;
+		}
+		res->cricount = ms->cricount;
+		res->nsetnext = ms->nsetnext;
+		for (res->nnodes = 0, k = 1; k <= side * side; k++) {
+			res->nnodes += ms->stats.depthnodes[k];
+		}
+		res->nbytes = ms->out->nbytes;
+	}
+	free(sets);
+	free(msmem);
+	return same;
+}
+
+/** Prints in JSON the workload and its result, with the minimum, median, mean
+ * and standard deviation of the seconds and the rates of the median. */
+void magicsquare_benchprint(int side, char filterlevel, char fillderived,
+			const int *corners, int nrepeats,
+			magicsquare_benchresult *res, char last) {
+	double min, median, mean = 0, var = 0;
+	int r;
+	qsort(res->seconds, nrepeats, sizeof(double), magicsquare_cmpdouble);
+	min = res->seconds[0];
+	median = nrepeats % 2 ? res->seconds[nrepeats / 2]
+		: (res->seconds[nrepeats / 2 - 1]
+			+ res->seconds[nrepeats / 2]) / 2;
+	for (r = 0; r < nrepeats; r++) {
+		mean += res->seconds[r] / nrepeats;
+	}
+	for (r = 0; r < nrepeats; r++) {
+		var += (res->seconds[r] - mean) * (res->seconds[r] - mean);
+	}
+	var = nrepeats > 1 ? var / (nrepeats - 1) : 0;
+	printf("    {\"size\": %d, \"filter\": %d, \"fill\": %d, "
+		"\"corners\": [", side, filterlevel, fillderived);
+	if (corners) {
+		printf("%d, %d, %d, %d", corners[0], corners[1], corners[2],
+			corners[3]);
+	}
+	printf("],\n     \"squares\": %lu, \"nodes\": %llu, "
+		"\"setnext\": %llu, \"bytes\": %llu,\n"
+		"     \"seconds\": {\"min\": %.6f, \"median\": %.6f, "
+		"\"mean\": %.6f, \"stddev\": %.6f},\n",
+		res->cricount, res->nnodes, res->nsetnext, res->nbytes,
+		min, median, mean, magicsquare_sqrt(var));
+	if (median <= 0) {
+		median = 1e-9;
+	}
+	printf("     \"nodes_per_sec\": %.0f, \"squares_per_sec\": %.0f, "
+		"\"ns_per_setnext\": %.2f, \"bytes_per_sec\": %.0f}%s\n",
+		res->nnodes / median, res->cricount / median,
+		res->nsetnext ? median * 1e9 / res->nsetnext : 0.0,
+		res->nbytes / median, last ? "" : ",");
+}
+
+/** Measures the search with fixed workloads repeated the given number of times,
+ * printing the results in JSON to the standard output and writing the squares
+ * in the print style of the options to /dev/null: all the 3x3 and 4x4 squares
+ * for each filter level with and without filling the derived numbers, and the
+ * 5x5 squares of some fixed numbers of the corners with the filter level 4.
+ * Returns 0 if any workload found different squares in its repetitions. */
+char magicsquare_benchmark(const magicsquare_config *cfg, int nrepeats) {
+	magicsquare_benchresult res;
+	int side, fd = open("/dev/null", O_WRONLY), c;
+	char filterlevel, fillderived, ok = 1;
+	res.seconds = malloc(nrepeats * sizeof(double));
+	if (fd < 0 || res.seconds == NULL) {
+		perror("Cannot prepare the benchmark");
+		return 0;
+	}
+	printf("{\"benchmark\": \"magicsquare\", \"repeats\": %d, "
+		"\"printstyle\": %d, \"dynamicorder\": %d, \"linesets\": %d, "
+		"\"linepairs\": %d,\n  \"workloads\": [\n", nrepeats,
+		cfg->printstyle, cfg->dynamicorder, cfg->linesets,
+		cfg->linepairs);
+	for (side = 3; side <= 4; side++) {
+		for (filterlevel = 0; filterlevel <= 4; filterlevel++) {
+			for (fillderived = 1; fillderived >= 0; fillderived--) {
+				ok &= magicsquare_benchrun(cfg, side,
+					filterlevel, fillderived, NULL,
+					nrepeats, fd, &res);
+				magicsquare_benchprint(side, filterlevel,
+					fillderived, NULL, nrepeats, &res, 0);
+				fflush(stdout);
+			}
+		}
+	}
+	for (c = 0; c < MAGSQ_NBENCHCORNERS; c++) {
+		ok &= magicsquare_benchrun(cfg, 5, 4, 1,
+				magicsquare_benchcorners[c], nrepeats, fd,
+				&res);
+		magicsquare_benchprint(5, 4, 1, magicsquare_benchcorners[c],
+				nrepeats, &res, c == MAGSQ_NBENCHCORNERS - 1);
+		fflush(stdout);
+	}
+	printf("  ]\n}\n");
+	close(fd);
+	free(res.seconds);
+	if (! ok) {
+		fprintf(stderr, "The repetitions found different squares\n");
+	}
+	return ok;
+}
+
+/* seed of the generator of the probes, fixed to repeat the same estimates */
+#define MAGSQ_PROBESEED 0x9E3779B97F4A7C15ULL
+
+/** Sums of the estimates of the nodes and the squares of the search tree given
+ * by the probes, to get their means and confidence intervals, with the nodes
+ * and the seconds of the subtrees really searched to estimate the time. */
+typedef struct magicsquare_treesize_st {
+	unsigned long nprobes;
+	unsigned long long nsearched;
+	double nodes, nodes2, squares, squares2, seconds;
+} magicsquare_treesize;
+
+/** Adds to the given sums the estimates of one probe from the position of the
+ * state, with the functions specialized for its side as magicsquare_search. */
+void magicsquare_probe(magicsquare ms, unsigned long long *rng,
+			magicsquare_treesize *ts) {
+	double nodes = 0, squares = 0;
+	switch (sumsquare_lines(ms->sq) == SUMSQ_MAGICLINES ? ms->side : 0) {
+	case 3:
+		magicsquare_probe_3(ms, rng, &nodes, &squares);
+		break;
+	case 4:
+		magicsquare_probe_4(ms, rng, &nodes, &squares);
+		break;
+	case 5:
+		magicsquare_probe_5(ms, rng, &nodes, &squares);
+		break;
+	case 6:
+		magicsquare_probe_6(ms, rng, &nodes, &squares);
+		break;
+	case 7:
+		magicsquare_probe_7(ms, rng, &nodes, &squares);
+		break;
+	case 8:
+		magicsquare_probe_8(ms, rng, &nodes, &squares);
+		break;
+	default:
+		magicsquare_probe_any(ms, rng, &nodes, &squares);
+	}
+	ts->nprobes++;
+	ts->nodes += nodes;
+	ts->nodes2 += nodes * nodes;
+	ts->squares += squares;
+	ts->squares2 += squares * squares;
+}
+
+/** Measures the seconds of the nodes of the search of the state following
+ * random paths from its position, that write and check the numbers as the
+ * search does, and saves them in the given sums. The paths are not weighted,
+ * so every node written counts once, and they are timed instead of searching
+ * whole subtrees because the probes cannot bound the size of the subtrees.
+ * They use the functions specialized for its side as magicsquare_search, so
+ * the rate of the nodes is the one of the search. */
+void magicsquare_calibrate(magicsquare ms, unsigned long long *rng,
+				magicsquare_treesize *ts) {
+	double nodes, start = magicsquare_now();
+	switch (sumsquare_lines(ms->sq) == SUMSQ_MAGICLINES ? ms->side : 0) {
+	case 3:
+		nodes = magicsquare_calibrate_3(ms, rng);
+		break;
+	case 4:
+		nodes = magicsquare_calibrate_4(ms, rng);
+		break;
+	case 5:
+		nodes = magicsquare_calibrate_5(ms, rng);
+		break;
+	case 6:
+		nodes = magicsquare_calibrate_6(ms, rng);
+		break;
+	case 7:
+		nodes = magicsquare_calibrate_7(ms, rng);
+		break;
+	case 8:
+		nodes = magicsquare_calibrate_8(ms, rng);
+		break;
+	default:
+		nodes = magicsquare_calibrate_any(ms, rng);
+	}
+	ts->seconds = magicsquare_now() - start;
+	ts->nsearched = nodes;
+}
+
+/* returns the half width of the confidence interval of 95% of the mean of the
+ * n values of the given sum and sum of squares */
+static double magicsquare_halfwidth(double sum, double sum2, unsigned long n) {
+	double mean = sum / n, var;
+	if (n < 2) {
+		return 0;
+	}
+	var = (sum2 - n * mean * mean) / (n - 1);
+	return 1.96 * magicsquare_sqrt(var / n);
+}
+
+/* returns the seconds of the given nodes at the rate of the nodes searched */
+static double magicsquare_treeseconds(const magicsquare_treesize *ts,
+					double nodes) {
+	return ts->nsearched ? nodes * ts->seconds / ts->nsearched : 0;
+}
+
+/** Prints the estimates of the nodes, the squares and the seconds of the search
+ * with one thread of the given sums, with the half widths of their intervals
+ * of 95%. */
+void magicsquare_printtreesize(const char *title,
+				const magicsquare_treesize *ts) {
+	unsigned long n = ts->nprobes;
+	double hwnodes = magicsquare_halfwidth(ts->nodes, ts->nodes2, n);
+	printf("%s: nodes %.4g +- %.2g, squares %.4g +- %.2g, "
+		"seconds %.4g +- %.2g\n", title, ts->nodes / n, hwnodes,
+		ts->squares / n, magicsquare_halfwidth(ts->squares,
+		ts->squares2, n), magicsquare_treeseconds(ts, ts->nodes / n),
+		magicsquare_treeseconds(ts, hwnodes));
+}
+
+/* returns a state to estimate the search of the given options with the given
+ * filter level, without the cut depth and the output, whose tail is only used
+ * by the probes to count the squares */
+static magicsquare magicsquare_estimator(char *mem,
+		const magicsquare_config *cfg, char filterlevel, sumsets sets) {
+	magicsquare ms = magicsquare_init(mem, cfg->side, cfg->lines,
+					filterlevel, 0, cfg->fillderived);
+	ms->dynamicorder = cfg->dynamicorder;
+	ms->linepairs = cfg->linepairs;
+	ms->tailcells = cfg->tailcells;
+	ms->sets = sets;
+	return ms;
+}
+
+/* runs the given probes from the unit of work of the state, that found the
+ * given next position, printing the unit with its numbers and its estimates
+ * and adding them to the shard of the unit */
+static void magicsquare_estimateunit(magicsquare ms, int next, int nprobes,
+			unsigned long long *rng, magicsquare_treesize *shards,
+			int nshards) {
+	magicsquare_treesize ts = {0, 0, 0, 0, 0, 0, 0};
+	magicsquare_treesize *shard = shards + ms->unit % nshards;
+	int c, p, n;
+	if (next > 0) {
+		ms->pos = next;
+		for (p = 0; p < nprobes; p++) {
+			magicsquare_probe(ms, rng, &ts);
+		}
+	} else {
+		ts.nprobes = 1;
+		ts.squares = next == 0;
+	}
+	shard->nodes += ts.nodes / ts.nprobes;
+	shard->squares += ts.squares / ts.nprobes;
+	printf("unit %lu shard %lu:", ms->unit, ms->unit % nshards);
+	for (c = 0; c < sumsquare_ncells(ms->sq); c++) {
+		n = sumsquare_getnum(ms->sq, c);
+		printf(n ? "%s%d" : "%s", c ? "," : " ", n);
+	}
+	printf(" nodes %.4g squares %.4g\n", ts.nodes / ts.nprobes,
+		ts.squares / ts.nprobes);
+	ms->unit++;
+}
+
+/* estimates the units of work of the search from the given position in the
+ * order of the search: the subtrees found after trying cutdepth numbers that
+ * pass the checks and the squares completed before them. It walks with the
+ * functions for any side, that find the same units in the same order, since
+ * it only writes the few levels above the cut depth and the probes of each
+ * unit, that take the time, use the specialized ones. */
+static void magicsquare_estimateunits(magicsquare ms, int pos, int cutdepth,
+			int nprobes, unsigned long long *rng,
+			magicsquare_treesize *shards, int nshards) {
+	int next;
+	unsigned long long nderived = 0;
+	while (magicsquare_setnext_any(ms, pos)) {
+		next = magicsquare_expand_any(ms, pos, &nderived);
+		if (ms->ntried == cutdepth ? next != MAGSQ_FAILED : next == 0) {
+			magicsquare_estimateunit(ms, next, nprobes, rng, shards,
+						nshards);
+		} else if (next > 0) {
+			magicsquare_estimateunits(ms, next, cutdepth, nprobes,
+						rng, shards, nshards);
+		}
+		magicsquare_unfill_any(ms, pos);
+	}
+}
+
+/** Estimates the size of the search tree of the given options with the given
+ * number of random probes from the first position for each filter level valid
+ * for its lines, printing the estimated nodes, squares and seconds of one
+ * thread with their confidence intervals. When the probes of each unit are
+ * not 0, it prints also the estimates of each unit of work of the cut depth
+ * for the filter level of the options, with the given probes from each one,
+ * and the totals of each shard, so the number of shards can be chosen before
+ * the search.
+ * Returns 0 if there is not enough memory. */
+char magicsquare_estimate(const magicsquare_config *cfg, int nprobes,
+				int nunitprobes) {
+	char *msmem = malloc(MAGICSQUARE_BYTES(cfg->side)), filterlevel;
+	sumsets sets = cfg->linesets ? magicsquare_newsets(cfg->side) : NULL;
+	magicsquare_treesize ts, *shards;
+	magicsquare ms;
+	unsigned long long rng = MAGSQ_PROBESEED;
+	int p, k, maxlevel = cfg->lines & SUMSQ_BROKEN ? 2 : 4;
+	char title[32];
+	shards = calloc(cfg->nshards, sizeof(magicsquare_treesize));
+	if (msmem == NULL || shards == NULL) {
+		fprintf(stderr, "Not enough memory for size %d\n", cfg->side);
+		free(msmem);
+		free(shards);
+		free(sets);
+		return 0;
+	}
+	for (filterlevel = 0; filterlevel <= maxlevel; filterlevel++) {
+		ms = magicsquare_estimator(msmem, cfg, filterlevel, sets);
+		memset(&ts, 0, sizeof(ts));
+		for (p = 0; p < nprobes; p++) {
+			magicsquare_probe(ms, &rng, &ts);
+		}
+		magicsquare_calibrate(ms, &rng, &ts);
+		snprintf(title, sizeof(title), "filter %d", filterlevel);
+		magicsquare_printtreesize(title, &ts);
+		fflush(stdout);
+		if (filterlevel == cfg->filterlevel) {
+			for (k = 0; k < cfg->nshards; k++) {
+				shards[k].nsearched = ts.nsearched;
+				shards[k].seconds = ts.seconds;
+			}
+		}
+	}
+	if (nunitprobes) {
+		ms = magicsquare_estimator(msmem, cfg, cfg->filterlevel, sets);
+		magicsquare_estimateunits(ms, ms->pos, cfg->cutdepth,
+				nunitprobes, &rng, shards, cfg->nshards);
+		for (k = 0; k < cfg->nshards; k++) {
+			printf("shard %d: nodes %.4g squares %.4g "
+				"seconds %.4g\n", k, shards[k].nodes,
+				shards[k].squares,
+				magicsquare_treeseconds(shards + k,
+							shards[k].nodes));
+		}
+	}
+	free(shards);
+	free(sets);
+	free(msmem);
+	return 1;
+}
+
+/** Writes in the state the numbers of the given partial square as fixed
+ * positions that are never restored, followed by the derived numbers of the
+ * lines with only one hole when they are filled, so the search only tries the
+ * empty positions. Returns 0 if the square cannot be completed: when it has
+ * repeated numbers, lines that cannot get the magic sum with the available
+ * numbers or numbers discarded by the filter level. */
+char magicsquare_fix(magicsquare ms, sumsquare partial) {
+	sumsquare sq = ms->sq;
+	int c, l, n, ln1hole, ncells = sumsquare_ncells(sq);
+	magicsquare_unwind(ms);
+	ms->cricount = 0;
+	for (c = 0; c < ncells; c++) {
+		n = sumsquare_getnum(partial, c);
+		if (n) {
+			if (sortednlist_isremoved(ms->nl, n)) {
+				return 0;
+			}
+			magicsquare_push(ms, c + 1, n, MAGSQ_TRIEDNUM);
+		}
+	}
+	do {
+#if ! INCREMENTAL_CHECKS
+		sortednlistsums_get(ms->sm, ms->nl);
+#endif
+		for (l = 0, ln1hole = -1; l < sumsquare_nlines(sq); l++) {
+			if (! magicsquare_checkline(sq, ms->nl, ms->sm,
+					sumsquare_linemsum(sq, l), l,
+					ms->stats.prunes)) {
+				return 0;
+			} else if (sumsquare_getlinecount(sq, l).holes == 1) {
+				ln1hole = l;
+			}
+		}
+		if (! magicsquare_countequiv(sq, ms->filterlevel,
+						ms->stats.prunes)) {
+			return 0;
+		}
+		if (ms->fillderived && ln1hole > -1) {
+			magicsquare_push(ms,
+				sumsquare_emptycell(sq, ln1hole) + 1,
+				sumsquare_linemsum(sq, ln1hole)
+				- sumsquare_getlinecount(sq, ln1hole).sum,
+				MAGSQ_DERIVEDNUM);
+			ms->stats.nderived++;
+		}
+	} while (ms->fillderived && ln1hole > -1);
+	ms->base = sortednlist_nremoved(ms->pl);
+	ms->pos = sortednlist_first(ms->pl);
+	return 1;
+}
+
+/** Searches with the given state the magic squares that complete the given
+ * partial square, leaving their count in cricount. */
+void magicsquare_searchpartial(magicsquare ms, sumsquare partial) {
+	if (magicsquare_fix(ms, partial)) {
+		if (ms->pos == 0) {
+			magicsquare_found(ms);
+		} else {
+			magicsquare_search(ms);
+		}
+	}
+}
+
+/** Reads from the standard input partial squares in the one line style, one
+ * per line with empty holes, and searches with a single state the magic squares
+ * that complete each one and pass the filter level, printing them or printing
+ * the count of each partial square with the print style 0.
+ * Returns 0 if any partial square was not valid. */
+char magicsquare_complete(const magicsquare_config *cfg) {
+	char text[SUMSQ_MAXLINELEN], ok = 1;
+	char *msmem = malloc(MAGICSQUARE_BYTES(cfg->side));
+	char *sqmem = malloc(SUMSQUARE_BYTES(cfg->side));
+	sumsets sets = cfg->linesets ? magicsquare_newsets(cfg->side) : NULL;
+	unsigned long nsquares = 0;
+	sumsquare partial;
+	magicsquare ms;
+	if (msmem == NULL || sqmem == NULL) {
+		fprintf(stderr, "Not enough memory for size %d\n", cfg->side);
+		exit(1);
+	}
+	partial = sumsquare_init(sqmem, cfg->side, cfg->lines);
+	ms = magicsquare_init(msmem, cfg->side, cfg->lines, cfg->filterlevel,
+				cfg->printstyle, cfg->fillderived);
+	ms->dynamicorder = cfg->dynamicorder;
+	ms->linepairs = cfg->linepairs;
+	ms->tailcells = cfg->printstyle ? 0 : cfg->tailcells;
+	ms->sets = sets;
+	magicsquare_printheader(ms->out, cfg->printstyle, cfg->filterlevel);
+	while (fgets(text, SUMSQ_MAXLINELEN, stdin)) {
+		nsquares++;
+		if (! sumsquare_readpartial(partial, text)) {
+			fprintf(stderr, "Square %lu is not a valid partial "
+				"square\n", nsquares);
+			ok = 0;
+			continue;
+		}
+		magicsquare_searchpartial(ms, partial);
+		if (cfg->printstyle == 0) {
+			printf("%lu\n", ms->cricount);
+		}
+	}
+	sumsquare_writer_flush(ms->out);
+	if (cfg->stats) {
+		magicsquare_printstats(&ms, 1, 0);
+	}
+	free(msmem);
+	free(sqmem);
+	free(sets);
+	return ok;
+}
+
+/** Returns a negative number, zero or a positive number if the first square
+ * would be generated before, at the same time or after the second one. The
+ * search tries the numbers of the positions in the order of the given array,
+ * filling the derived numbers only after all the previous positions. */
+int magicsquare_compare(sumsquare sq1, sumsquare sq2, const int *order) {
+	int k, ncells = sumsquare_ncells(sq1);
+	for (k = 0; k < ncells; k++) {
+		if (sumsquare_getnum(sq1, order[k])
+				!= sumsquare_getnum(sq2, order[k])) {
+			return sumsquare_getnum(sq1, order[k])
+				- sumsquare_getnum(sq2, order[k]);
+		}
+	}
+	return 0;
+}
+
+/** Saves in the given array the positions of the squares of the given side
+ * minus one in the order that the search tries them, as compared by
+ * magicsquare_compare. Returns 0 if there is not enough memory. */
+char magicsquare_searchorder(int *order, int side) {
+	int k, pos, ncells = side * side;
+	char *plmem = malloc(SORTEDNLIST_BYTES(ncells));
+	sortednlist pl;
+	if (plmem == NULL) {
+		return 0;
+	}
+	pl = sortednlist_init(plmem, ncells);
+	magicsquare_initpositionsorder(pl, side);
+	for (k = 0, pos = sortednlist_first(pl); pos;
+			k++, pos = sortednlist_next(pl, pos)) {
+		order[k] = pos - 1;
+	}
+	free(plmem);
+	return 1;
+}
+
+/** Merges the squares of the given files printed by the shards of a search,
+ * printing them in the order they would be printed by a single search, or
+ * printing the sum of their counts. Each file must be in the order of the
+ * search, as printed by one thread, and returns 0 if any is not valid. */
+char magicsquare_merge(const magicsquare_config *cfg, int nfiles,
+			char **names) {
+	int side = cfg->side, ncells = side * side;
+	size_t bytes = SUMSQUARE_BYTES(side);
+	char *mem, *outmem;
+	sumsquare_writer out;
+	sumsquare *sqs, sq, prev;
+	FILE **files;
+	int f, minf, *order = malloc(ncells * sizeof(int)), *status;
+	int hside, hfilterlevel;
+	unsigned long count, cricount = 0;
+	unsigned char fixedwidth;
+	char binary = cfg->printstyle == 5 || cfg->printstyle == 6, hshort;
+	if (order == NULL || ! magicsquare_searchorder(order, side)) {
+		fprintf(stderr, "Not enough memory for size %d\n", side);
+		exit(1);
+	}
+	mem = malloc((nfiles + 1) * bytes);
+	sqs = malloc((nfiles + 1) * sizeof(sumsquare));
+	files = malloc(nfiles * sizeof(FILE *));
+	status = malloc(nfiles * sizeof(int));
+	outmem = malloc(SUMSQUARE_WRITER_BYTES(side, MAGSQ_OUTPUTBYTES));
+	if (mem == NULL || sqs == NULL || files == NULL || status == NULL
+			|| outmem == NULL) {
+		fprintf(stderr, "Not enough memory for %d files\n", nfiles);
+		exit(1);
+	}
+	for (f = 0; f <= nfiles; f++) {
+		sqs[f] = sumsquare_init(mem + f * bytes, side,
+					SUMSQ_MAGICLINES);
+	}
+	prev = sqs[nfiles];
+	fixedwidth = sumsquare_fixedwidth(prev, FIXEDWIDTH_BASE);
+	out = sumsquare_writer_init(outmem, side, MAGSQ_OUTPUTBYTES,
+			STDOUT_FILENO, FIXEDWIDTH_BASE, fixedwidth);
+	for (f = 0; f < nfiles; f++) {
+		files[f] = fopen(names[f], "r");
+		if (files[f] == NULL) {
+			perror(names[f]);
+			exit(1);
+		}
+		if (binary && (! sumsquare_readheader(files[f], &hside,
+					&hfilterlevel, &hshort)
+				|| hside != side
+				|| hfilterlevel != cfg->filterlevel
+				|| hshort != (cfg->printstyle == 5))) {
+			fprintf(stderr, "%s: not squares of this search\n",
+				names[f]);
+			exit(1);
+		}
+		if (cfg->printstyle == 0) {
+			status[f] = fscanf(files[f], "%lu", &count) == 1
+					? 0 : -1;
+			cricount += count;
+		} else {
+			status[f] = sumsquare_read(sqs[f], files[f],
+				cfg->printstyle, FIXEDWIDTH_BASE, fixedwidth);
+		}
+	}
+	magicsquare_printheader(out, cfg->printstyle, cfg->filterlevel);
+	while (1) {
+		minf = -1;
+		for (f = 0; f < nfiles; f++) {
+			if (status[f] < 0) {
+				sumsquare_writer_flush(out);
+				fprintf(stderr, "%s: invalid square\n",
+					names[f]);
+				exit(1);
+			} else if (status[f] && (minf < 0
+					|| magicsquare_compare(sqs[f],
+						sqs[minf], order) < 0)) {
+				minf = f;
+			}
+		}
+		if (minf < 0) {
+			break;
+		}
+		sq = sqs[minf];
+		magicsquare_print(out, sq, cfg->printstyle);
+		sqs[minf] = prev;
+		prev = sq;
+		status[minf] = sumsquare_read(sqs[minf], files[minf],
+				cfg->printstyle, FIXEDWIDTH_BASE, fixedwidth);
+		if (status[minf] > 0 && magicsquare_compare(sqs[minf], prev,
+							order) < 0) {
+			sumsquare_writer_flush(out);
+			fprintf(stderr, "%s: squares not in the search order\n",
+				names[minf]);
+			exit(1);
+		}
+	}
+	for (f = 0; f < nfiles; f++) {
+		fclose(files[f]);
+	}
+	sumsquare_writer_flush(out);
+	if (cfg->printstyle == 0) {
+		printf("%lu\n", cricount);
+	}
+	free(outmem);
+	free(status);
+	free(files);
+	free(sqs);
+	free(mem);
+	free(order);
+	return 1;
+}
+
+/** Reads the squares written in a binary print style in the given files and
+ * writes them in the print style of the options, or prints their count with the
+ * print style 0. The size, the filter level and the format of the squares are
+ * read from the header of the files, that must be equal in all of them, and
+ * returns 0 if any file is not valid. */
+char magicsquare_decode(const magicsquare_config *cfg, int nfiles,
+			char **names) {
+	char *mem = NULL, *outmem = NULL, shortformat = 0, fshort;
+	sumsquare sq = NULL;
+	sumsquare_writer out = NULL;
+	FILE *f;
+	int i, status, side = 0, filterlevel = 0, fside, ffilterlevel;
+	unsigned long cricount = 0;
+	for (i = 0; i < nfiles; i++) {
+		f = fopen(names[i], "r");
+		if (f == NULL) {
+			perror(names[i]);
+			exit(1);
+		}
+		if (! sumsquare_readheader(f, &fside, &ffilterlevel, &fshort)
+				|| fside > MAGSQ_MAXSIDE || (i && (fside != side
+					|| ffilterlevel != filterlevel
+					|| fshort != shortformat))) {
+			fprintf(stderr, "%s: not squares of the same binary "
+				"style\n", names[i]);
+			exit(1);
+		}
+		if (i == 0) {
+			side = fside;
+			filterlevel = ffilterlevel;
+			shortformat = fshort;
+			mem = malloc(SUMSQUARE_BYTES(side));
+			outmem = malloc(SUMSQUARE_WRITER_BYTES(side,
+							MAGSQ_OUTPUTBYTES));
+			if (mem == NULL || outmem == NULL) {
+				fprintf(stderr, "Not enough memory for size "
+					"%d\n", side);
+				exit(1);
+			}
+			sq = sumsquare_init(mem, side, SUMSQ_MAGICLINES);
+			out = sumsquare_writer_init(outmem, side,
+				MAGSQ_OUTPUTBYTES, STDOUT_FILENO,
+				FIXEDWIDTH_BASE,
+				sumsquare_fixedwidth(sq, FIXEDWIDTH_BASE));
+			magicsquare_printheader(out, cfg->printstyle,
+						filterlevel);
+		}
+		while ((status = sumsquare_read(sq, f, shortformat ? 5 : 6,
+				FIXEDWIDTH_BASE, out->fixedwidth)) > 0) {
+			cricount++;
+			magicsquare_print(out, sq, cfg->printstyle);
+		}
+		fclose(f);
+		if (status < 0) {
+			sumsquare_writer_flush(out);
+			fprintf(stderr, "%s: invalid square\n", names[i]);
+			exit(1);
+		}
+	}
+	if (out) {
+		sumsquare_writer_flush(out);
+	}
+	if (cfg->printstyle == 0) {
+		printf("%lu\n", cricount);
+	}
+	free(outmem);
+	free(mem);
+	return 1;
+}
+
+/* bytes of the number of a square in the records of the deduplication */
+#define MAGSQ_INDEXBYTES 8
+
+/* saves the given number in big-endian order to sort the records by it */
+static void magicsquare_putindex(char *rec, unsigned long idx) {
+	int b;
+	for (b = MAGSQ_INDEXBYTES - 1; b >= 0; b--, idx >>= 8) {
+		rec[b] = idx & 0xFF;
+	}
+}
+
+/* returns the number saved by magicsquare_putindex */
+static unsigned long magicsquare_getindex(const char *rec) {
+	unsigned long idx = 0;
+	int b;
+	for (b = 0; b < MAGSQ_INDEXBYTES; b++) {
+		idx = (idx << 8) | (unsigned char) rec[b];
+	}
+	return idx;
+}
+
+/** Index of the canonical forms of the squares read to remove the repeated
+ * ones, keeping in memory the records of the canonical forms found with their
+ * number in the input, in the order of the input and found by a hash table, and
+ * writing them sorted to temporary files when the memory is full. At the end
+ * the files are merged to remove the repeated forms and the first ones found
+ * are sorted again by their number to write them in the order of the input. */
+typedef struct magicsquare_dedup_st {
+	int ncells, reclen;
+	unsigned long nduplicates, hashmask;
+	unsigned int *hash;
+	char *keysmem, *firstsmem;
+	sortedruns keys, firsts;
+} *magicsquare_dedup;
+
+/** Returns a new index of canonical forms of squares with the given number of
+ * cells using approximately the given bytes of memory. */
+magicsquare_dedup magicsquare_dedupinit(size_t bytes, int ncells) {
+	magicsquare_dedup d = malloc(sizeof(struct magicsquare_dedup_st));
+	int reclen = ncells + MAGSQ_INDEXBYTES;
+	size_t nrecs = bytes / (reclen + reclen + 16), nhash = 1;
+	if (d == NULL || nrecs < 1) {
+		free(d);
+		return NULL;
+	}
+	while (nhash < nrecs + nrecs) {
+		nhash *= 2;
+	}
+	d->ncells = ncells;
+	d->reclen = reclen;
+	d->nduplicates = 0;
+	d->hashmask = nhash - 1;
+	d->hash = calloc(nhash, sizeof(unsigned int));
+	d->keysmem = malloc(SORTEDRUNS_BYTES(reclen, nrecs));
+	d->firstsmem = malloc(SORTEDRUNS_BYTES(reclen, nrecs));
+	if (d->hash == NULL || d->keysmem == NULL || d->firstsmem == NULL) {
+		free(d->firstsmem);
+		free(d->keysmem);
+		free(d->hash);
+		free(d);
+		return NULL;
+	}
+	d->keys = sortedruns_init(d->keysmem, reclen, nrecs);
+	d->firsts = sortedruns_init(d->firstsmem, reclen, nrecs);
+	return d;
+}
+
+/* returns the hash of the numbers of a canonical form */
+static unsigned long magicsquare_dedughash(const SUMSQ_NUMTYPE *key,
+						int ncells) {
+	unsigned long h = 2166136261UL;
+	int c;
+	for (c = 0; c < ncells; c++) {
+		h = (h ^ key[c]) * 16777619UL;
+	}
+	return h;
+}
+
+/** Adds the canonical form of the square of the given number in the input,
+ * reporting it with the number of a previous equivalent square when the form
+ * is already in memory and returning 0 in this case. The repeated forms whose
+ * previous form was written to the temporary files are reported at the end
+ * with the number of the first equivalent square. */
+char magicsquare_dedupadd(magicsquare_dedup d, const SUMSQ_NUMTYPE *key,
+				unsigned long idx) {
+	unsigned long h = magicsquare_dedughash(key, d->ncells) & d->hashmask;
+	char *rec;
+	while (d->hash[h]) {
+		rec = sortedruns_get(d->keys, d->hash[h] - 1);
+		if (memcmp(rec, key, d->ncells) == 0) {
+			fprintf(stderr, "Square %lu is equivalent to square "
+				"%lu\n", idx + 1,
+				magicsquare_getindex(rec + d->ncells) + 1);
+			d->nduplicates++;
+			return 0;
+		}
+		h = (h + 1) & d->hashmask;
+	}
+	if (sortedruns_full(d->keys)) {
+		if (! sortedruns_spill(d->keys)) {
+			exit(1);
+		}
+		memset(d->hash, 0, (d->hashmask + 1) * sizeof(unsigned int));
+		h = magicsquare_dedughash(key, d->ncells) & d->hashmask;
+	}
+	rec = sortedruns_add(d->keys, (const char *) key);
+	magicsquare_putindex(rec + d->ncells, idx);
+	d->hash[h] = sortedruns_len(d->keys);
+	return 1;
+}
+
+/* writes the square of a canonical form with the given print style */
+static void magicsquare_dedupprint(sumsquare_writer out, sumsquare sq,
+			const SUMSQ_NUMTYPE *key, char printstyle) {
+	int c;
+	for (c = 0; c < sumsquare_ncells(sq); c++) {
+		sumsquare_setnum(sq, c, key[c]);
+	}
+	magicsquare_print(out, sq, printstyle);
+}
+
+/** Writes the canonical forms added that are not repeated in the order of the
+ * input, after merging the temporary files to report the remaining repeated
+ * ones, and returns 0 if the temporary files could not be written or read. */
+char magicsquare_dedupend(magicsquare_dedup d, sumsquare_writer out,
+				sumsquare sq, char printstyle) {
+	int ncells = d->ncells, reclen = d->reclen, status;
+	char *rec = malloc(reclen), *first = malloc(reclen);
+	size_t i;
+	if (rec == NULL || first == NULL) {
+		free(first);
+		free(rec);
+		return 0;
+	}
+	if (d->keys->nruns == 0) {
+		for (i = 0; i < sortedruns_len(d->keys); i++) {
+			magicsquare_dedupprint(out, sq, (SUMSQ_NUMTYPE *)
+				sortedruns_get(d->keys, i), printstyle);
+		}
+		free(first);
+		free(rec);
+		return 1;
+	}
+	if (! sortedruns_merge(d->keys)) {
+		free(first);
+		free(rec);
+		return 0;
+	}
+	for (i = 0; (status = sortedruns_next(d->keys, rec)) > 0; i++) {
+		if (i && memcmp(rec, first + MAGSQ_INDEXBYTES, ncells) == 0) {
+			fprintf(stderr, "Square %lu is equivalent to square "
+				"%lu\n", magicsquare_getindex(rec + ncells) + 1,
+				magicsquare_getindex(first) + 1);
+			d->nduplicates++;
+			continue;
+		}
+		memcpy(first, rec + ncells, MAGSQ_INDEXBYTES);
+		memcpy(first + MAGSQ_INDEXBYTES, rec, ncells);
+		if (sortedruns_full(d->firsts)
+				&& ! sortedruns_spill(d->firsts)) {
+			status = -1;
+			break;
+		}
+		sortedruns_add(d->firsts, first);
+	}
+	if (status == 0 && sortedruns_merge(d->firsts)) {
+		while ((status = sortedruns_next(d->firsts, rec)) > 0) {
+			magicsquare_dedupprint(out, sq, (SUMSQ_NUMTYPE *)
+				(rec + MAGSQ_INDEXBYTES), printstyle);
+		}
+	} else {
+		status = -1;
+	}
+	free(first);
+	free(rec);
+	return status == 0;
+}
+
+/** Removes the temporary files and the memory of the index. */
+void magicsquare_dedupclose(magicsquare_dedup d) {
+	sortedruns_close(d->keys);
+	sortedruns_close(d->firsts);
+	free(d->keysmem);
+	free(d->firstsmem);
+	free(d->hash);
+	free(d);
+}
+
+/* bytes of the chunks of the input validated by each thread */
+#define MAGSQ_INPUTBYTES (1 << 20)
+
+/* modes of the validation, writing the valid squares, all their symmetries,
+ * their canonical forms or only the canonical forms not repeated */
+#define MAGSQ_CHECK 0
+#define MAGSQ_EXPAND 1
+#define MAGSQ_CANONICAL 2
+#define MAGSQ_UNIQUE 3
+
+/* makes the given array have space for one more element after the n first */
+static void magicsquare_reserve(void *parr, unsigned long *pmax,
+				unsigned long n, size_t elemsize) {
+	void **arr = (void **) parr;
+	if (n == *pmax) {
+		*pmax = *pmax * 2 + 16;
+		*arr = realloc(*arr, *pmax * elemsize);
+		if (*arr == NULL) {
+			fprintf(stderr, "Not enough memory\n");
+			exit(1);
+		}
+	}
+}
+
+/** Input of the squares validated by several threads, that read it in turns
+ * in chunks of whole squares, saving the rest of the last square for the next
+ * chunk, and that write their valid squares in the order of the chunks, each
+ * one transformed by the tables of the given symmetries, the first one being
+ * the identity, or add their canonical forms to the index of the squares. */
+typedef struct magicsquare_input_st {
+	int fd, side;
+	char instyle, outstyle, eof, error, mode, filterlevel;
+	magicsquare_dedup dedup;
+	char *rest;
+	int nrest, nsymmetries;
+	SUMSQ_NUMTYPE *symmetries;
+	unsigned long nextchunk, nextwrite, nsquares, nvalid;
+	pthread_mutex_t readlock, writelock;
+	pthread_cond_t turn;
+} *magicsquare_input;
+
+/** Chunk of the input validated by one thread with its own squares and writer,
+ * saving the indexes in the chunk of the squares that are not valid and the
+ * canonical forms of the valid ones with their indexes when removing the
+ * repeated squares. */
+typedef struct magicsquare_chunk_st {
+	magicsquare_input in;
+	char *text;
+	int len;
+	unsigned long id, nsquares, nvalid, ninvalid, maxinvalid, *invalid;
+	unsigned long maxkeys, maxkeyidxs, *keyidxs;
+	SUMSQ_NUMTYPE *keys;
+	sumsquare sq, var, best;
+	sumsquare_writer out;
+} *magicsquare_chunk;
+
+/* returns the length of the whole squares of the given text of a style */
+static int magicsquare_chunklen(const char *text, int len, char style,
+				int side) {
+	int n;
+	if (style == 5 || style == 6) {
+		n = sumsquare_binarylen(side, style == 5);
+		return len - len % n;
+	}
+	for (n = len; n > 0; n--) {
+		if (text[n - 1] == '\n' && (style != 4
+				|| (n > 1 && text[n - 2] == '\n'))) {
+			break;
+		}
+	}
+	return n;
+}
+
+/** Reads the next chunk of the input, after the rest of the previous chunk,
+ * returning 0 at the end of the input. The last line of the text styles is
+ * ended with a newline when the input does not end with it. */
+char magicsquare_readchunk(magicsquare_chunk ch) {
+	magicsquare_input in = ch->in;
+	ssize_t n;
+	int len;
+	pthread_mutex_lock(&in->readlock);
+	memcpy(ch->text, in->rest, in->nrest);
+	ch->len = in->nrest;
+	while (! in->eof && ch->len < MAGSQ_INPUTBYTES) {
+		n = read(in->fd, ch->text + ch->len,
+				MAGSQ_INPUTBYTES - ch->len);
+		if (n > 0) {
+			ch->len += n;
+		} else if (n == 0 || errno != EINTR) {
+			if (n < 0) {
+				perror("Cannot read the squares");
+				in->error = 1;
+			}
+			in->eof = 1;
+		}
+	}
+	len = in->eof ? ch->len : magicsquare_chunklen(ch->text, ch->len,
+						in->instyle, in->side);
+	if (len == 0) {
+		len = ch->len;
+	}
+	in->nrest = ch->len - len;
+	memcpy(in->rest, ch->text + len, in->nrest);
+	ch->len = len;
+	if (in->eof && len && in->instyle < 5 && ch->text[len - 1] != '\n') {
+		ch->text[ch->len++] = '\n';
+	}
+	ch->id = in->nextchunk++;
+	pthread_mutex_unlock(&in->readlock);
+	return ch->len > 0;
+}
+
+/** Waits until the previous chunks are written, so the chunk can write. */
+void magicsquare_waitturn(magicsquare_chunk ch) {
+	magicsquare_input in = ch->in;
+	pthread_mutex_lock(&in->writelock);
+	while (in->nextwrite != ch->id) {
+		pthread_cond_wait(&in->turn, &in->writelock);
+	}
+	pthread_mutex_unlock(&in->writelock);
+}
+
+/** Parses and checks the squares of the chunk, writing the valid ones in the
+ * mode of the validation in the output style when it is the turn of the chunk
+ * or when its writer is full, and reporting the squares that are not valid with
+ * their number in the input. When removing the repeated squares, the canonical
+ * forms are added to the index in the turn of the chunk. */
+void magicsquare_validatechunk(magicsquare_chunk ch) {
+	magicsquare_input in = ch->in;
+	sumsquare_writer out = ch->out;
+	sumsquare canon;
+	const char *text = ch->text;
+	unsigned long i;
+	int k, status, ncells = sumsquare_ncells(ch->sq);
+	ch->nsquares = ch->nvalid = ch->ninvalid = 0;
+	while ((status = sumsquare_parse(ch->sq, &text, ch->text + ch->len,
+			in->instyle, FIXEDWIDTH_BASE, out->fixedwidth))) {
+		if (status > 0 && sumsquare_ismagic(ch->sq)
+				&& in->mode >= MAGSQ_CANONICAL) {
+			canon = magicsquare_canonical(ch->sq, ch->var, ch->best,
+					in->symmetries, in->nsymmetries,
+					in->filterlevel);
+			if (in->mode == MAGSQ_UNIQUE) {
+				magicsquare_reserve(&ch->keys, &ch->maxkeys,
+					ch->nvalid, ncells);
+				magicsquare_reserve(&ch->keyidxs,
+					&ch->maxkeyidxs, ch->nvalid,
+					sizeof(unsigned long));
+				memcpy(ch->keys + ch->nvalid * ncells,
+					canon->nums, ncells);
+				ch->keyidxs[ch->nvalid] = ch->nsquares;
+			} else {
+				if (out->size - out->len < out->maxlen) {
+					magicsquare_waitturn(ch);
+					sumsquare_writer_flush(out);
+				}
+				magicsquare_print(out, canon, in->outstyle);
+			}
+			ch->nvalid++;
+		} else if (status > 0 && sumsquare_ismagic(ch->sq)) {
+			for (k = 0; k < in->nsymmetries; k++) {
+				if (k) {
+					sumsquare_permute(ch->var, ch->sq,
+						in->symmetries + k * ncells);
+				}
+				if (out->size - out->len < out->maxlen) {
+					magicsquare_waitturn(ch);
+					sumsquare_writer_flush(out);
+				}
+				magicsquare_print(out, k ? ch->var : ch->sq,
+						in->outstyle);
+			}
+			ch->nvalid++;
+		} else {
+			magicsquare_reserve(&ch->invalid, &ch->maxinvalid,
+				ch->ninvalid, sizeof(unsigned long));
+			ch->invalid[ch->ninvalid++] = ch->nsquares;
+		}
+		ch->nsquares++;
+	}
+	magicsquare_waitturn(ch);
+	sumsquare_writer_flush(out);
+	for (i = 0; i < ch->ninvalid; i++) {
+		fprintf(stderr, "Square %lu is not a valid magic square\n",
+			in->nsquares + ch->invalid[i] + 1);
+	}
+	for (i = 0; in->mode == MAGSQ_UNIQUE && i < ch->nvalid; i++) {
+		magicsquare_dedupadd(in->dedup, ch->keys + i * ncells,
+					in->nsquares + ch->keyidxs[i]);
+	}
+	pthread_mutex_lock(&in->writelock);
+	in->nsquares += ch->nsquares;
+	in->nvalid += ch->nvalid;
+	in->nextwrite++;
+	pthread_cond_broadcast(&in->turn);
+	pthread_mutex_unlock(&in->writelock);
+}
+
+/** Validates the chunks of the input read in turns until its end. */
+static void *magicsquare_validatethread(void *ch) {
+	while (magicsquare_readchunk((magicsquare_chunk) ch)) {
+		magicsquare_validatechunk((magicsquare_chunk) ch);
+	}
+	return NULL;
+}
+
+/** Reads from the standard input the squares printed in the given style and
+ * writes the magic squares in the print style of the options, or prints their
+ * count with the print style 0, reporting the squares that are not magic. The
+ * input is read in big chunks validated by the given number of threads, and the
+ * binary styles read the size and the filter level from their header. When
+ * expanding, it also writes the squares filtered by the filter level with the
+ * transformations of each square, and the modes of the canonical forms write
+ * instead the form of each square accepted by the filter level, all of them or
+ * only the first of the equivalent squares, reporting the repeated ones and
+ * using the given megabytes of memory for the index of the forms. Returns 0 if
+ * any square is not valid or if the input cannot be read. */
+char magicsquare_validate(const magicsquare_config *cfg, char instyle,
+				char mode, int dedupmb) {
+	struct magicsquare_input_st in;
+	magicsquare_chunk *chunks;
+	pthread_t *threads;
+	char *mem, *cmem, shortformat;
+	int t, side = cfg->side, filterlevel = cfg->filterlevel;
+	int nthreads = cfg->nthreads > 1 ? cfg->nthreads : 1;
+	unsigned char header[SUMSQ_BINARY_HEADERLEN];
+	size_t bytes;
+	ssize_t n;
+	if (instyle == 5 || instyle == 6) {
+		for (t = 0; t < SUMSQ_BINARY_HEADERLEN; t += n) {
+			n = read(STDIN_FILENO, header + t,
+					SUMSQ_BINARY_HEADERLEN - t);
+			if (n <= 0) {
+				break;
+			}
+		}
+		if (t < SUMSQ_BINARY_HEADERLEN
+				|| ! sumsquare_parseheader(header, &side,
+						&filterlevel, &shortformat)
+				|| side > MAGSQ_MAXSIDE) {
+			fprintf(stderr, "Invalid header of binary squares\n");
+			return 0;
+		}
+		instyle = shortformat ? 5 : 6;
+	}
+	bytes = MAGSQ_ALIGNED(sizeof(struct magicsquare_chunk_st))
+		+ MAGSQ_ALIGNED(SUMSQUARE_BYTES(side))
+		+ MAGSQ_ALIGNED(SUMSQUARE_BYTES(side))
+		+ MAGSQ_ALIGNED(SUMSQUARE_BYTES(side))
+		+ MAGSQ_ALIGNED(SUMSQUARE_WRITER_BYTES(side, MAGSQ_OUTPUTBYTES))
+		+ MAGSQ_INPUTBYTES + 1;
+	mem = malloc(nthreads * bytes);
+	chunks = malloc(nthreads * sizeof(magicsquare_chunk));
+	threads = malloc(nthreads * sizeof(pthread_t));
+	in.rest = malloc(MAGSQ_INPUTBYTES);
+	in.symmetries = malloc(MAGSQ_SYMMETRIESBYTES(side));
+	in.dedup = mode != MAGSQ_UNIQUE ? NULL : magicsquare_dedupinit(
+			(size_t) dedupmb << 20, side * side);
+	if (mem == NULL || chunks == NULL || threads == NULL
+			|| in.rest == NULL || in.symmetries == NULL
+			|| (mode == MAGSQ_UNIQUE && in.dedup == NULL)) {
+		fprintf(stderr, "Not enough memory for %d threads\n", nthreads);
+		exit(1);
+	}
+	in.fd = STDIN_FILENO;
+	in.side = side;
+	in.instyle = instyle;
+	in.outstyle = cfg->printstyle;
+	in.eof = 0;
+	in.error = 0;
+	in.mode = mode;
+	in.filterlevel = filterlevel;
+	in.nrest = 0;
+	in.nsymmetries = magicsquare_symmetries(in.symmetries, side,
+				mode != MAGSQ_CHECK ? filterlevel : 0);
+	in.nextchunk = 0;
+	in.nextwrite = 0;
+	in.nsquares = 0;
+	in.nvalid = 0;
+	pthread_mutex_init(&in.readlock, NULL);
+	pthread_mutex_init(&in.writelock, NULL);
+	pthread_cond_init(&in.turn, NULL);
+	for (t = 0; t < nthreads; t++) {
+		cmem = mem + t * bytes;
+		chunks[t] = (magicsquare_chunk) cmem;
+		cmem += MAGSQ_ALIGNED(sizeof(struct magicsquare_chunk_st));
+		chunks[t]->in = &in;
+		chunks[t]->sq = sumsquare_init(cmem, side, cfg->lines);
+		cmem += MAGSQ_ALIGNED(SUMSQUARE_BYTES(side));
+		chunks[t]->var = sumsquare_init(cmem, side, cfg->lines);
+		cmem += MAGSQ_ALIGNED(SUMSQUARE_BYTES(side));
+		chunks[t]->best = sumsquare_init(cmem, side, cfg->lines);
+		cmem += MAGSQ_ALIGNED(SUMSQUARE_BYTES(side));
+		chunks[t]->out = sumsquare_writer_init(cmem, side,
+			MAGSQ_OUTPUTBYTES, STDOUT_FILENO, FIXEDWIDTH_BASE,
+			sumsquare_fixedwidth(chunks[t]->sq, FIXEDWIDTH_BASE));
+		cmem += MAGSQ_ALIGNED(SUMSQUARE_WRITER_BYTES(side,
+							MAGSQ_OUTPUTBYTES));
+		chunks[t]->text = cmem;
+		chunks[t]->maxinvalid = 0;
+		chunks[t]->invalid = NULL;
+		chunks[t]->maxkeys = 0;
+		chunks[t]->maxkeyidxs = 0;
+		chunks[t]->keys = NULL;
+		chunks[t]->keyidxs = NULL;
+	}
+	magicsquare_printheader(chunks[0]->out, cfg->printstyle,
+				mode == MAGSQ_EXPAND ? 0 : filterlevel);
+	if (nthreads < 2) {
+		magicsquare_validatethread(chunks[0]);
+	} else {
+		for (t = 0; t < nthreads; t++) {
+			if (pthread_create(threads + t, NULL,
+					magicsquare_validatethread,
+					chunks[t])) {
+				fprintf(stderr, "Cannot create thread %d\n", t);
+				exit(1);
+			}
+		}
+		for (t = 0; t < nthreads; t++) {
+			pthread_join(threads[t], NULL);
+		}
+	}
+	if (mode == MAGSQ_UNIQUE) {
+		if (! magicsquare_dedupend(in.dedup, chunks[0]->out,
+					chunks[0]->sq, cfg->printstyle)) {
+			fprintf(stderr, "Cannot remove the repeated squares\n");
+			in.error = 1;
+		}
+		sumsquare_writer_flush(chunks[0]->out);
+		in.nvalid -= in.dedup->nduplicates;
+		in.nsquares -= in.dedup->nduplicates;
+		magicsquare_dedupclose(in.dedup);
+	}
+	if (cfg->printstyle == 0) {
+		printf("%lu\n", mode == MAGSQ_EXPAND
+				? in.nvalid * in.nsymmetries : in.nvalid);
+	}
+	for (t = 0; t < nthreads; t++) {
+		free(chunks[t]->invalid);
+		free(chunks[t]->keys);
+		free(chunks[t]->keyidxs);
+	}
+	pthread_cond_destroy(&in.turn);
+	pthread_mutex_destroy(&in.writelock);
+	pthread_mutex_destroy(&in.readlock);
+	free(in.symmetries);
+	free(in.rest);
+	free(threads);
+	free(chunks);
+	free(mem);
+	return ! in.error && in.nvalid == in.nsquares;
+}
+
+/* header of the archives of squares, followed by a byte with the side, one
+ * with the filter level, one with the bits of each number, one with the base 2
+ * logarithm of the bytes of the blocks, and the number of squares and the
+ * number of blocks saved like the numbers of the records of the
+ * deduplication */
+#define MAGSQ_ARCHIVE_MAGIC "MSQA"
+#define MAGSQ_ARCHIVE_HEADERLEN (8 + 2 * MAGSQ_INDEXBYTES)
+#define MAGSQ_ARCHIVE_BLOCKLOG 12
+
+/* bytes at the start of each block with the number of its squares */
+#define MAGSQ_ARCHIVE_COUNTBYTES 2
+
+/** Archive of squares in the order of the search, that saves each square as the
+ * length of the prefix of its numbers in the order of the positions tried by
+ * the search that is equal to the previous square, in nbits bits, followed by
+ * the rest of its numbers minus one in nbits bits each, except the numbers of
+ * the positions that complete a line of the previous positions, that are
+ * derived from the magic sum like in the search. The squares are packed
+ * in blocks of a fixed size that start with a whole square, followed by an
+ * index with the numbers of the first square of each block, so the squares of
+ * a given prefix are found by a binary search of the index and decoding only
+ * the blocks that can contain them. */
+typedef struct magicsquare_archive_st {
+	FILE *f;
+	int side, ncells, nbits, filterlevel, blockbytes;
+	int *order;              /* positions of the search order minus one */
+	int *rank;               /* index in the order of each cell */
+	int *derived;            /* line completed by each position plus one */
+	int msum;
+	unsigned char *nums;     /* numbers of the last square in the order */
+	unsigned char *block;    /* block being written or the last one read */
+	unsigned char *index;    /* numbers of the first square of each block */
+	unsigned long nsquares, nblocks, maxblocks, nblock;
+	int blocksquares, nread, bitpos;  /* squares and bits of the block */
+} magicsquare_archive;
+
+/* writes the given value in the next nbits bits of the buffer, that must be
+ * zero, from the most significant bit of each byte */
+static void magicsquare_putbits(unsigned char *buf, int *pbit, int value,
+				int nbits) {
+	for (nbits--; nbits >= 0; nbits--, (*pbit)++) {
+		if (value >> nbits & 1) {
+			buf[*pbit >> 3] |= 0x80 >> (*pbit & 7);
+		}
+	}
+}
+
+/* returns the value written by magicsquare_putbits in the next nbits bits */
+static int magicsquare_getbits(const unsigned char *buf, int *pbit, int nbits) {
+	int value = 0;
+	for (; nbits > 0; nbits--, (*pbit)++) {
+		value = (value << 1)
+			| (buf[*pbit >> 3] >> (7 - (*pbit & 7)) & 1);
+	}
+	return value;
+}
+
+/* returns the cell of the given index of the line l of the magic squares of
+ * the given side: the rows, the columns and the two diagonals */
+static int magicsquare_linecell(int side, int l, int idx) {
+	return l < side ? l * side + idx
+		: l < 2 * side ? idx * side + l - side
+		: l == 2 * side ? idx * side + idx
+		: idx * side + side - 1 - idx;
+}
+
+/* saves the index in the order of each cell and for each position of the order
+ * the first line plus one whose other cells are in previous positions, or 0 if
+ * there is none */
+static void magicsquare_archivederived(magicsquare_archive *a) {
+	int k, l, idx, last, side = a->side;
+	for (k = 0; k < a->ncells; k++) {
+		a->rank[a->order[k]] = k;
+		a->derived[k] = 0;
+	}
+	for (l = 0; l < 2 * side + 2; l++) {
+		for (idx = 0, last = 0; idx < side; idx++) {
+			k = a->rank[magicsquare_linecell(side, l, idx)];
+			last = k > last ? k : last;
+		}
+		if (! a->derived[last]) {
+			a->derived[last] = l + 1;
+		}
+	}
+}
+
+/* allocates the memory of the archive for its side and block size */
+static char magicsquare_archivealloc(magicsquare_archive *a) {
+	a->ncells = a->side * a->side;
+	a->nbits = sumsquare_binarybits(a->side);
+	a->order = malloc(a->ncells * sizeof(int));
+	a->rank = malloc(a->ncells * sizeof(int));
+	a->derived = malloc(a->ncells * sizeof(int));
+	a->msum = a->side * (a->ncells + 1) / 2;
+	a->nums = malloc(a->ncells);
+	a->block = malloc(a->blockbytes);
+	a->index = NULL;
+	a->nsquares = a->nblocks = a->maxblocks = 0;
+	a->nblock = 0;
+	a->blocksquares = a->nread = 0;
+	if (a->order == NULL || a->rank == NULL || a->derived == NULL
+			|| a->nums == NULL || a->block == NULL
+			|| ! magicsquare_searchorder(a->order, a->side)) {
+		return 0;
+	}
+	magicsquare_archivederived(a);
+	return 1;
+}
+
+/** Frees the memory of the archive and closes its file. */
+void magicsquare_archivefree(magicsquare_archive *a) {
+	fclose(a->f);
+	free(a->index);
+	free(a->block);
+	free(a->nums);
+	free(a->derived);
+	free(a->rank);
+	free(a->order);
+}
+
+/** Creates the archive of the given name for the squares of the given side and
+ * filter level, returning 0 if the file cannot be created. */
+char magicsquare_archivecreate(magicsquare_archive *a, const char *name,
+				int side, int filterlevel) {
+	unsigned char header[MAGSQ_ARCHIVE_HEADERLEN] = {0};
+	a->f = fopen(name, "w");
+	if (a->f == NULL) {
+		return 0;
+	}
+	a->side = side;
+	a->filterlevel = filterlevel;
+	a->blockbytes = 1 << MAGSQ_ARCHIVE_BLOCKLOG;
+	if (! magicsquare_archivealloc(a)) {
+		fprintf(stderr, "Not enough memory for size %d\n", side);
+		exit(1);
+	}
+	return fwrite(header, MAGSQ_ARCHIVE_HEADERLEN, 1, a->f) == 1;
+}
+
+/* writes the block with its number of squares */
+static char magicsquare_archivewriteblock(magicsquare_archive *a) {
+	a->block[0] = a->blocksquares >> 8;
+	a->block[1] = a->blocksquares & 0xFF;
+	return fwrite(a->block, a->blockbytes, 1, a->f) == 1;
+}
+
+/** Adds the given square to the archive, returning 0 if it is not after the
+ * previous square in the order of the search or the file cannot be written. */
+char magicsquare_archiveadd(magicsquare_archive *a, sumsquare sq) {
+	int k, p, nbits, ncells = a->ncells;
+	for (p = 0; a->nsquares && p < ncells && a->nums[p]
+			== sumsquare_getnum(sq, a->order[p]); p++) { }
+	if (a->nsquares && (p == ncells
+			|| sumsquare_getnum(sq, a->order[p]) < a->nums[p])) {
+		return 0;
+	}
+	for (k = p, nbits = a->nbits; k < ncells; k++) {
+		nbits += a->derived[k] ? 0 : a->nbits;
+	}
+	if (a->blocksquares == 0 || a->bitpos + nbits > a->blockbytes * 8) {
+		if (a->blocksquares && ! magicsquare_archivewriteblock(a)) {
+			return 0;
+		}
+		magicsquare_reserve(&a->index, &a->maxblocks, a->nblocks,
+					ncells);
+		memset(a->block, 0, a->blockbytes);
+		a->bitpos = MAGSQ_ARCHIVE_COUNTBYTES * 8;
+		a->blocksquares = 0;
+		a->nblocks++;
+		p = 0;
+	}
+	for (k = p; k < ncells; k++) {
+		a->nums[k] = sumsquare_getnum(sq, a->order[k]);
+	}
+	if (a->blocksquares == 0) {
+		memcpy(a->index + (a->nblocks - 1) * ncells, a->nums, ncells);
+	}
+	magicsquare_putbits(a->block, &a->bitpos, p, a->nbits);
+	for (k = p; k < ncells; k++) {
+		if (! a->derived[k]) {
+			magicsquare_putbits(a->block, &a->bitpos,
+					a->nums[k] - 1, a->nbits);
+		}
+	}
+	a->blocksquares++;
+	a->nsquares++;
+	return 1;
+}
+
+/** Writes the last block, the index and the header of the archive and closes
+ * it, returning 0 if the file cannot be written. */
+char magicsquare_archiveclose(magicsquare_archive *a) {
+	unsigned char header[MAGSQ_ARCHIVE_HEADERLEN];
+	char ok = ! a->blocksquares || magicsquare_archivewriteblock(a);
+	memcpy(header, MAGSQ_ARCHIVE_MAGIC, 4);
+	header[4] = a->side;
+	header[5] = a->filterlevel;
+	header[6] = a->nbits;
+	header[7] = MAGSQ_ARCHIVE_BLOCKLOG;
+	magicsquare_putindex((char *) header + 8, a->nsquares);
+	magicsquare_putindex((char *) header + 8 + MAGSQ_INDEXBYTES,
+				a->nblocks);
+	ok = ok && (! a->nblocks || fwrite(a->index, a->nblocks * a->ncells, 1,
+						a->f) == 1)
+		&& fseek(a->f, 0, SEEK_SET) == 0
+		&& fwrite(header, MAGSQ_ARCHIVE_HEADERLEN, 1, a->f) == 1
+		&& fflush(a->f) == 0;
+	magicsquare_archivefree(a);
+	return ok;
+}
+
+/** Opens the archive of the given name reading its header and its index,
+ * returning 0 if it is not a valid archive. */
+char magicsquare_archiveopen(magicsquare_archive *a, const char *name) {
+	unsigned char header[MAGSQ_ARCHIVE_HEADERLEN];
+	unsigned long nblocks;
+	a->f = fopen(name, "r");
+	if (a->f == NULL) {
+		perror(name);
+		exit(1);
+	}
+	if (fread(header, MAGSQ_ARCHIVE_HEADERLEN, 1, a->f) != 1
+			|| memcmp(header, MAGSQ_ARCHIVE_MAGIC, 4) != 0
+			|| header[4] < MAGSQ_MINSIDE
+			|| header[4] > MAGSQ_MAXSIDE
+			|| header[5] > 4
+			|| header[6] != sumsquare_binarybits(header[4])
+			|| header[7] < 8 || header[7] > 24) {
+		fclose(a->f);
+		return 0;
+	}
+	a->side = header[4];
+	a->filterlevel = header[5];
+	a->blockbytes = 1 << header[7];
+	if (! magicsquare_archivealloc(a)) {
+		fprintf(stderr, "Not enough memory for size %d\n", a->side);
+		exit(1);
+	}
+	a->nsquares = magicsquare_getindex((char *) header + 8);
+	nblocks = magicsquare_getindex((char *) header + 8 + MAGSQ_INDEXBYTES);
+	a->index = malloc(nblocks * a->ncells + 1);
+	if (a->index == NULL) {
+		fprintf(stderr, "Not enough memory for the index\n");
+		exit(1);
+	}
+	a->nblocks = nblocks;
+	a->nblock = nblocks;
+	if (fseek(a->f, MAGSQ_ARCHIVE_HEADERLEN + nblocks * a->blockbytes,
+				SEEK_SET) != 0 || (nblocks && fread(a->index,
+				nblocks * a->ncells, 1, a->f) != 1)) {
+		magicsquare_archivefree(a);
+		return 0;
+	}
+	return 1;
+}
+
+/* reads the given block of the archive to decode its squares, if it is not
+ * the last block read, returning 0 if it is not valid */
+static char magicsquare_archivereadblock(magicsquare_archive *a,
+					unsigned long b) {
+	if (b != a->nblock) {
+		if (fseek(a->f, MAGSQ_ARCHIVE_HEADERLEN + b * a->blockbytes,
+					SEEK_SET) != 0
+				|| fread(a->block, a->blockbytes, 1,
+					a->f) != 1) {
+			return 0;
+		}
+		a->nblock = b;
+	}
+	a->blocksquares = (a->block[0] << 8) | a->block[1];
+	a->bitpos = MAGSQ_ARCHIVE_COUNTBYTES * 8;
+	a->nread = 0;
+	return a->blocksquares > 0;
+}
+
+/** Decodes in nums the next square of the block read, returning 1, or 0 at the
+ * end of the block, or -1 if the square is not valid. */
+int magicsquare_archivenext(magicsquare_archive *a) {
+	int k, p, n, idx, c, side = a->side;
+	if (a->nread == a->blocksquares) {
+		return 0;
+	}
+	p = magicsquare_getbits(a->block, &a->bitpos, a->nbits);
+	if (p >= a->ncells || (a->nread == 0 && p > 0)) {
+		return -1;
+	}
+	for (k = p; k < a->ncells; k++) {
+		if (a->derived[k]) {
+			for (idx = 0, n = a->msum; idx < side; idx++) {
+				c = magicsquare_linecell(side,
+						a->derived[k] - 1, idx);
+				n -= c == a->order[k] ? 0 : a->nums[a->rank[c]];
+			}
+		} else if (a->bitpos + a->nbits > a->blockbytes * 8) {
+			return -1;
+		} else {
+			n = magicsquare_getbits(a->block, &a->bitpos,
+						a->nbits) + 1;
+		}
+		if (n < 1 || n > a->ncells) {
+			return -1;
+		}
+		a->nums[k] = n;
+	}
+	a->nread++;
+	return 1;
+}
+
+/** Reads the squares printed in the print style of the options in the given
+ * files, or in the standard input without files, that must be in the order of
+ * the search of the options, as printed by magicsquare_merge, and saves them in
+ * an archive with the given name. Returns 0 if any square is not valid. */
+char magicsquare_pack(const magicsquare_config *cfg, const char *archivename,
+			int nfiles, char **names) {
+	char *mem = malloc(SUMSQUARE_BYTES(cfg->side)), hshort;
+	char binary = cfg->printstyle == 5 || cfg->printstyle == 6;
+	const char *name;
+	magicsquare_archive a;
+	sumsquare sq;
+	unsigned char fixedwidth;
+	int i, status, hside, hfilterlevel;
+	FILE *f;
+	if (mem == NULL) {
+		fprintf(stderr, "Not enough memory for size %d\n", cfg->side);
+		exit(1);
+	}
+	sq = sumsquare_init(mem, cfg->side, SUMSQ_MAGICLINES);
+	fixedwidth = sumsquare_fixedwidth(sq, FIXEDWIDTH_BASE);
+	if (! magicsquare_archivecreate(&a, archivename, cfg->side,
+					cfg->filterlevel)) {
+		perror(archivename);
+		exit(1);
+	}
+	for (i = 0; i < nfiles || (i == 0 && nfiles == 0); i++) {
+		name = nfiles ? names[i] : "standard input";
+		f = nfiles ? fopen(name, "r") : stdin;
+		if (f == NULL) {
+			perror(name);
+			exit(1);
+		}
+		if (binary && (! sumsquare_readheader(f, &hside,
+					&hfilterlevel, &hshort)
+				|| hside != cfg->side
+				|| hfilterlevel != cfg->filterlevel
+				|| hshort != (cfg->printstyle == 5))) {
+			fprintf(stderr, "%s: not squares of this search\n",
+				name);
+			exit(1);
+		}
+		while ((status = sumsquare_read(sq, f, cfg->printstyle,
+					FIXEDWIDTH_BASE, fixedwidth)) > 0) {
+			if (! sumsquare_ismagic(sq)) {
+				fprintf(stderr, "%s: square %lu is not magic\n",
+					name, a.nsquares + 1);
+				exit(1);
+			}
+			if (! magicsquare_archiveadd(&a, sq)) {
+				fprintf(stderr, "%s: squares not in the search "
+					"order\n", name);
+				exit(1);
+			}
+		}
+		if (status < 0) {
+			fprintf(stderr, "%s: invalid square\n", name);
+			exit(1);
+		}
+		if (nfiles) {
+			fclose(f);
+		}
+	}
+	if (! magicsquare_archiveclose(&a)) {
+		perror(archivename);
+		exit(1);
+	}
+	free(mem);
+	return 1;
+}
+
+/** Reads from the standard input partial squares in the one line style, one
+ * per line with empty holes, and prints the squares of the archive of the given
+ * name that complete each one, or prints their count with the print style 0.
+ * The longest prefix of fixed positions in the order of the search is found by
+ * a binary search of the index of the archive, decoding only the blocks with
+ * that prefix and checking the rest of fixed positions in their squares.
+ * Returns 0 if any partial square was not valid. */
+char magicsquare_query(const magicsquare_config *cfg, const char *archivename) {
+	char text[SUMSQ_MAXLINELEN], *mem, *outmem, ok = 1;
+	unsigned char query[MAGSQ_MAXSIDE * MAGSQ_MAXSIDE];
+	magicsquare_archive a;
+	sumsquare sq, partial;
+	sumsquare_writer out;
+	unsigned long nsquares = 0, cricount, lo, hi, mid, b;
+	int k, c, ncells, nprefix, status;
+	if (! magicsquare_archiveopen(&a, archivename)) {
+		fprintf(stderr, "%s: not a valid archive\n", archivename);
+		exit(1);
+	}
+	ncells = a.ncells;
+	mem = malloc(2 * SUMSQUARE_BYTES(a.side));
+	outmem = malloc(SUMSQUARE_WRITER_BYTES(a.side, MAGSQ_OUTPUTBYTES));
+	if (mem == NULL || outmem == NULL) {
+		fprintf(stderr, "Not enough memory for size %d\n", a.side);
+		exit(1);
+	}
+	sq = sumsquare_init(mem, a.side, SUMSQ_MAGICLINES);
+	partial = sumsquare_init(mem + SUMSQUARE_BYTES(a.side), a.side,
+				SUMSQ_MAGICLINES);
+	out = sumsquare_writer_init(outmem, a.side, MAGSQ_OUTPUTBYTES,
+		STDOUT_FILENO, FIXEDWIDTH_BASE,
+		sumsquare_fixedwidth(sq, FIXEDWIDTH_BASE));
+	magicsquare_printheader(out, cfg->printstyle, a.filterlevel);
+	while (fgets(text, SUMSQ_MAXLINELEN, stdin)) {
+		nsquares++;
+		if (! sumsquare_readpartial(partial, text)) {
+			fprintf(stderr, "Square %lu is not a valid partial "
+				"square\n", nsquares);
+			ok = 0;
+			continue;
+		}
+		for (k = 0, nprefix = ncells; k < ncells; k++) {
+			query[k] = sumsquare_getnum(partial, a.order[k]);
+			if (query[k] == 0 && nprefix == ncells) {
+				nprefix = k;
+			}
+		}
+		for (lo = 0, hi = a.nblocks; lo < hi; ) {
+			mid = lo + (hi - lo) / 2;
+			if (memcmp(a.index + mid * ncells, query,
+					nprefix) < 0) {
+				lo = mid + 1;
+			} else {
+				hi = mid;
+			}
+		}
+		cricount = 0;
+		for (b = lo ? lo - 1 : 0, c = 0; b < a.nblocks && c <= 0; b++) {
+			if (! magicsquare_archivereadblock(&a, b)) {
+				fprintf(stderr, "%s: invalid block %lu\n",
+					archivename, b);
+				exit(1);
+			}
+			while (c <= 0
+				&& (status = magicsquare_archivenext(&a))) {
+				if (status < 0) {
+					fprintf(stderr, "%s: invalid square in "
+						"block %lu\n", archivename, b);
+					exit(1);
+				}
+				c = memcmp(a.nums, query, nprefix);
+				for (k = nprefix; c == 0 && k < ncells
+						&& (! query[k]
+						|| query[k] == a.nums[k]);
+						k++) {
+				}
+				if (c != 0 || k < ncells) {
+					continue;
+				}
+				for (k = 0; k < ncells; k++) {
+					sumsquare_setnum(sq, a.order[k],
+							a.nums[k]);
+				}
+				cricount++;
+				magicsquare_print(out, sq, cfg->printstyle);
+			}
+		}
+		if (cfg->printstyle == 0) {
+			printf("%lu\n", cricount);
+		}
+	}
+	sumsquare_writer_flush(out);
+	magicsquare_archivefree(&a);
+	free(outmem);
+	free(mem);
+	return ok;
+}
+
+/** Squares of each size kept by a thread of the server between requests: a
+ * search state and a square to read the requests, created on first use. */
+typedef struct magicsquare_templates_st {
+	magicsquare states[MAGSQ_MAXSIDE + 1];
+	sumsquare squares[MAGSQ_MAXSIDE + 1];
+} magicsquare_templates;
+
+/** Listening socket of the server and options of its threads. */
+typedef struct magicsquare_server_st {
+	int fd;
+	const magicsquare_config *cfg;
+} *magicsquare_server;
+
+/* writes all the given text to the given descriptor, returning 0 if it could
+ * not be written */
+static char magicsquare_writeall(int fd, const char *text, size_t len) {
+	ssize_t n;
+	while (len) {
+		n = write(fd, text, len);
+		if (n > 0) {
+			text += n;
+			len -= n;
+		} else if (n == 0 || errno != EINTR) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/* writes the last line of a response with the given prefix and text */
+static char magicsquare_reply(int fd, char prefix, const char *text) {
+	char line[128];
+	int len = snprintf(line, sizeof(line), "%c %s\n", prefix, text);
+	return magicsquare_writeall(fd, line, len);
+}
+
+/* returns the state of the given side of the templates, creating it and its
+ * square the first time, or NULL if there is not enough memory */
+static magicsquare magicsquare_template(magicsquare_templates *tpl, int side,
+					const magicsquare_config *cfg) {
+	char *msmem, *sqmem;
+	if (tpl->states[side] == NULL) {
+		msmem = malloc(MAGICSQUARE_BYTES(side));
+		sqmem = malloc(SUMSQUARE_BYTES(side));
+		if (msmem == NULL || sqmem == NULL) {
+			free(msmem);
+			free(sqmem);
+			return NULL;
+		}
+		tpl->states[side] = magicsquare_init(msmem, side,
+				SUMSQ_MAGICLINES, FILTER_LEVEL, 3,
+				cfg->fillderived);
+		tpl->states[side]->dynamicorder = cfg->dynamicorder;
+		tpl->states[side]->linepairs = cfg->linepairs;
+		tpl->squares[side] = sumsquare_init(sqmem, side,
+							SUMSQ_MAGICLINES);
+	}
+	return tpl->states[side];
+}
+
+/** Answers the requests read from the given connection, one per line, until
+ * it is closed, with the given templates. Each request is a command, the size
+ * of the square and its arguments separated by spaces:
+ *     validate N SQUARE       answers "= 1" if the square is magic or "= 0"
+ *     complete N LEVEL SQUARE writes the squares that complete the partial
+ *                             square and pass the filter level, one per line,
+ *                             followed by "= COUNT"
+ *     count N LEVEL           answers "= COUNT" with the count of the squares
+ * The squares are written in the one line style, with empty holes in the
+ * partial squares, and the errors are answered with "! MESSAGE", so every
+ * response ends with a line that starts with "=" or "!". */
+void magicsquare_serveconn(int fd, magicsquare_templates *tpl,
+				const magicsquare_config *cfg) {
+	char text[SUMSQ_MAXLINELEN], cmd[16], count[32];
+	int c, side, filterlevel, off, len, ok = 1;
+	char validate, complete;
+	FILE *f = fdopen(fd, "r");
+	magicsquare ms;
+	sumsquare sq;
+	if (f == NULL) {
+		close(fd);
+		return;
+	}
+	while (ok && fgets(text, SUMSQ_MAXLINELEN, f)) {
+		off = 0;
+		len = 0;
+		filterlevel = 0;
+		if (sscanf(text, "%15s %d %n", cmd, &side, &off) < 2
+				|| side < MAGSQ_MINSIDE
+				|| side > MAGSQ_MAXSIDE) {
+			ok = magicsquare_reply(fd, '!', "invalid size");
+			continue;
+		}
+		validate = strcmp(cmd, "validate") == 0;
+		complete = strcmp(cmd, "complete") == 0;
+		if (! validate && ! complete && strcmp(cmd, "count") != 0) {
+			ok = magicsquare_reply(fd, '!', "unknown command");
+			continue;
+		}
+		if (! validate && (sscanf(text + off, "%d %n", &filterlevel,
+					&len) < 1
+				|| filterlevel < 0 || filterlevel > 4)) {
+			ok = magicsquare_reply(fd, '!', "invalid filter level");
+			continue;
+		}
+		off += len;
+		ms = magicsquare_template(tpl, side, cfg);
+		if (ms == NULL) {
+			ok = magicsquare_reply(fd, '!', "not enough memory");
+			continue;
+		}
+		sq = tpl->squares[side];
+		if (validate) {
+			ok = magicsquare_reply(fd, '=',
+				sumsquare_readdecimal(sq, text + off, ',')
+				&& sumsquare_ismagic(sq) ? "1" : "0");
+			continue;
+		} else if (complete
+				&& ! sumsquare_readpartial(sq, text + off)) {
+			ok = magicsquare_reply(fd, '!', "invalid square");
+			continue;
+		}
+		for (c = 0; ! complete && c < side * side; c++) {
+			sumsquare_setnum(sq, c, 0);
+		}
+		ms->filterlevel = filterlevel;
+		ms->printstyle = complete ? 3 : 0;
+		ms->tailcells = complete ? 0 : cfg->tailcells;
+		ms->out->fd = fd;
+		magicsquare_searchpartial(ms, sq);
+		snprintf(count, sizeof(count), "%lu", ms->cricount);
+		ok = sumsquare_writer_flush(ms->out)
+			&& magicsquare_reply(fd, '=', count);
+	}
+	fclose(f);
+}
+
+/* accepts the connections of the server and answers their requests until the
+ * socket is closed, keeping its own templates */
+static void *magicsquare_servethread(void *server) {
+	magicsquare_server sv = server;
+	magicsquare_templates tpl;
+	int side, fd;
+	for (side = 0; side <= MAGSQ_MAXSIDE; side++) {
+		tpl.states[side] = NULL;
+		tpl.squares[side] = NULL;
+	}
+	while ((fd = accept(sv->fd, NULL, NULL)) >= 0 || errno == EINTR
+			|| errno == ECONNABORTED) {
+		if (fd >= 0) {
+			magicsquare_serveconn(fd, &tpl, sv->cfg);
+		}
+	}
+	perror("Cannot accept connections");
+	for (side = 0; side <= MAGSQ_MAXSIDE; side++) {
+		free(tpl.states[side]);
+		free(tpl.squares[side]);
+	}
+	return NULL;
+}
+
+/** Serves the requests of magicsquare_serveconn received in the Unix socket of
+ * the given path, replacing an old socket in that path, with the given number
+ * of threads that accept the connections and answer them concurrently, each one
+ * keeping between requests the search states of the sizes requested.
+ * Returns 0 if the socket cannot be created or when it cannot accept more. */
+char magicsquare_serve(const magicsquare_config *cfg, const char *path) {
+	struct magicsquare_server_st sv;
+	struct sockaddr_un addr;
+	struct stat st;
+	pthread_t *threads = malloc(cfg->nthreads * sizeof(pthread_t));
+	int t;
+	if (threads == NULL) {
+		fprintf(stderr, "Not enough memory for %d threads\n",
+			cfg->nthreads);
+		exit(1);
+	}
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "%s: path of the socket too long\n", path);
+		return 0;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+		unlink(path);
+	}
+	sv.cfg = cfg;
+	sv.fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (sv.fd < 0 || bind(sv.fd, (struct sockaddr *) &addr,
+				sizeof(addr)) || listen(sv.fd, SOMAXCONN)) {
+		perror(path);
+		return 0;
+	}
+	signal(SIGPIPE, SIG_IGN);
+	for (t = 0; t < cfg->nthreads; t++) {
+		if (pthread_create(threads + t, NULL, magicsquare_servethread,
+					&sv)) {
+			fprintf(stderr, "Cannot create thread %d\n", t);
+			exit(1);
+		}
+	}
+	for (t = 0; t < cfg->nthreads; t++) {
+		pthread_join(threads[t], NULL);
+	}
+	close(sv.fd);
+	free(threads);
+	return 0;
+}
+
+/** Returns the kinds of lines of the given comma separated names, "magic" for
+ * the diagonals of the magic squares, "semi" for only rows and columns, "pan"
+ * for the broken diagonals and "assoc" for the pairs symmetric about the
+ * center, the diagonals being added unless "semi" is given, or -1 if any name
+ * is not valid or "semi" is given with "pan". */
+int magicsquare_parselines(const char *text) {
+	int lines = 0, semi = 0, len;
+	for (; *text; text += len + (text[len] == ',')) {
+		len = strcspn(text, ",");
+		if (len == 5 && strncmp(text, "magic", len) == 0) {
+			lines |= SUMSQ_DIAGONALS;
+		} else if (len == 4 && strncmp(text, "semi", len) == 0) {
+			semi = 1;
+		} else if (len == 3 && strncmp(text, "pan", len) == 0) {
+			lines |= SUMSQ_BROKEN;
+		} else if (len == 5 && strncmp(text, "assoc", len) == 0) {
+			lines |= SUMSQ_PAIRS;
+		} else {
+			return -1;
+		}
+	}
+	if (semi) {
+		return lines & (SUMSQ_DIAGONALS | SUMSQ_BROKEN) ? -1 : lines;
+	}
+	return lines | SUMSQ_DIAGONALS;
+}
+
+void magicsquare_usage(char *progname) {
+	printf("Usage: %s [OPTION]...\n"
+"Generates all the NxN magic squares, printing or counting them.\n\n"
+"  -n, --size=N         size of the magic squares, from %d to %d (default %d)\n"
+"  -f, --filter=LEVEL   filter level from 0 (all the squares) to 4 (only one\n"
+"                       of each 32 equivalent squares) (default %d)\n"
+"  -l, --lines=KINDS    lines with the magic sum besides rows and columns,\n"
+"                       separated by commas: magic (the diagonals, default),\n"
+"                       semi (none), pan (also the broken diagonals, up to\n"
+"                       -f 2) and assoc (also the pairs of cells symmetric\n"
+"                       about the center, with sum N*N+1)\n"
+"  -p, --print-style=NUM  0 counts, 1/2 short/long reduced, 3 one line,\n"
+"                       4 table, 5/6 short/long binary (default %d)\n"
+"  -T, --tail=NUM       with -p 0, count directly the squares that complete\n"
+"                       the last NUM empty positions, 0 never (default %d)\n"
+"  -D, --dynamic-order  after the corners, try first the empty position whose\n"
+"                       lines leave the fewest numbers for it, instead of the\n"
+"                       fixed order (the shards cannot be merged with -m)\n"
+"  -L, --line-sets      check that the lines can be completed to one of the\n"
+"                       sets of N numbers with the magic sum, up to size %d\n"
+"  -P, --partial        read from the standard input partial squares in the\n"
+"                       style 3 with empty holes and complete each one with\n"
+"                       all its magic squares, or count them with -p 0\n"
+"  -U, --socket=PATH    serve the requests to validate, complete and count\n"
+"                       squares received in the Unix socket PATH, answered\n"
+"                       by the threads given with -t\n"
+"  -j, --line-pairs     check that the pairs of lines can be completed\n"
+"                       together with the sums of the available numbers\n"
+"  -t, --threads=NUM    split the search between NUM threads (default 1)\n"
+"  -d, --cut-depth=NUM  number of tried numbers of the subtrees split between\n"
+"                       the threads (default %d, the four corners)\n"
+"  -c, --checkpoint=FILE  save in FILE the state of the search periodically\n"
+"                       and when terminated, to resume it later\n"
+"  -i, --interval=SECS  seconds between checkpoints (default %d)\n"
+"  -r, --resume         resume the search saved in the checkpoint file,\n"
+"                       truncating the output file to the saved offset\n"
+"  -s, --shard=K/M      search only the shard K (from 0 to M-1) of M shards\n"
+"                       formed by the subtrees of the cut depth in turns\n"
+"  -m, --merge FILE...  merge the squares printed by all the shards of a\n"
+"                       search in the same order of the whole search\n"
+"  -x, --decode FILE... print in the print style the squares of the files\n"
+"                       written in a binary print style\n"
+"  -a, --archive=ARCHIVE FILE...  save in ARCHIVE the squares of the files,\n"
+"                       or of the standard input, printed in the print style\n"
+"                       in the order of the search, compressing the prefix\n"
+"                       shared with the previous square\n"
+"  -q, --query=ARCHIVE  read from the standard input partial squares in the\n"
+"                       style 3 with empty holes and print the squares of\n"
+"                       ARCHIVE that complete each one, or count them\n"
+"                       with -p 0\n"
+"  -v, --validate=STYLE  read from the standard input squares printed in the\n"
+"                       print STYLE and print the magic ones in the print\n"
+"                       style\n"
+"  -e, --expand         with -v, print also the squares removed by the filter\n"
+"                       level, obtained by the symmetries of each square\n"
+"  -k, --canonical      with -v, print instead the equivalent square of each\n"
+"                       square that is accepted by the filter level\n"
+"  -u, --unique         with -v, print the equivalent squares of -k removing\n"
+"                       the repeated ones, that are reported\n"
+"  -M, --memory=MB      megabytes of memory of -u before using temporary\n"
+"                       files (default %d)\n"
+"  -S, --stats          print at the end to the standard error the numbers\n"
+"                       written by depth and position and the numbers\n"
+"                       discarded by each check, also printed on SIGUSR1\n"
+"  -g, --progress=SECS  print every SECS seconds to the standard error the\n"
+"                       estimated part of the search done, the squares, the\n"
+"                       nodes per second and the time remaining, also\n"
+"                       printed on SIGUSR2\n"
+"  -b, --benchmark=NUM  repeat NUM times fixed searches of 3x3, 4x4 and parts\n"
+"                       of 5x5 and print their times and rates in JSON\n"
+"  -E, --estimate=P[/Q]  estimate the nodes, squares and seconds of the\n"
+"                       search of each filter level without -T with P random\n"
+"                       paths, and with Q paths from each subtree of the cut\n"
+"                       depth, the estimates of the subtrees and of the M\n"
+"                       shards of -s\n"
+"  -h, --help           display this help and exit\n",
+		progname, MAGSQ_MINSIDE, MAGSQ_MAXSIDE, N, FILTER_LEVEL,
+		PRINT_STYLE, TAIL_CELLS, SUMSETS_MAXSIDE,
+		CUT_DEPTH, CHECKPOINT_INTERVAL, DEDUP_MEMORY);
+}
+
+static struct option magicsquare_longopts[] = {
+	{"size",       required_argument, NULL, 'n'},
+	{"filter",     required_argument, NULL, 'f'},
+	{"lines",      required_argument, NULL, 'l'},
+	{"print-style", required_argument, NULL, 'p'},
+	{"dynamic-order", no_argument,    NULL, 'D'},
+	{"line-sets",  no_argument,       NULL, 'L'},
+	{"line-pairs", no_argument,       NULL, 'j'},
+	{"partial",    no_argument,       NULL, 'P'},
+	{"tail",       required_argument, NULL, 'T'},
+	{"socket",     required_argument, NULL, 'U'},
+	{"threads",    required_argument, NULL, 't'},
+	{"cut-depth",  required_argument, NULL, 'd'},
+	{"checkpoint", required_argument, NULL, 'c'},
+	{"interval",   required_argument, NULL, 'i'},
+	{"resume",     no_argument,       NULL, 'r'},
+	{"shard",      required_argument, NULL, 's'},
+	{"merge",      no_argument,       NULL, 'm'},
+	{"decode",     no_argument,       NULL, 'x'},
+	{"archive",    required_argument, NULL, 'a'},
+	{"query",      required_argument, NULL, 'q'},
+	{"validate",   required_argument, NULL, 'v'},
+	{"expand",     no_argument,       NULL, 'e'},
+	{"canonical",  no_argument,       NULL, 'k'},
+	{"unique",     no_argument,       NULL, 'u'},
+	{"memory",     required_argument, NULL, 'M'},
+	{"stats",      no_argument,       NULL, 'S'},
+	{"progress",   required_argument, NULL, 'g'},
+	{"benchmark",  required_argument, NULL, 'b'},
+	{"estimate",   required_argument, NULL, 'E'},
+	{"help",       no_argument,       NULL, 'h'},
+	{NULL, 0, NULL, 0}
+};
+
+int main(int argc, char *argv[]) {
+	int opt, dedupmb = DEDUP_MEMORY, benchmark = 0, nprobes = 0;
+	int nunitprobes = 0, lines;
+	const char *socketpath = NULL, *archive = NULL, *query = NULL;
+	char merge = 0, decode = 0, validate = 0, partial = 0;
+	char mode = MAGSQ_CHECK, nmodes = 0;
+	magicsquare_config cfg;
+	cfg.lines = SUMSQ_MAGICLINES;
+	cfg.filterlevel = FILTER_LEVEL;
+	cfg.printstyle = PRINT_STYLE;
+	cfg.fillderived = FILL_DERIVED;
+	cfg.dynamicorder = 0;
+	cfg.linesets = 0;
+	cfg.linepairs = 0;
+	cfg.tailcells = TAIL_CELLS;
+	cfg.resume = 0;
+	cfg.stats = 0;
+	cfg.progress = 0;
+	cfg.side = N;
+	cfg.nthreads = 1;
+	cfg.cutdepth = CUT_DEPTH;
+	cfg.ckinterval = CHECKPOINT_INTERVAL;
+	cfg.ckfile = NULL;
+	cfg.shard = 0;
+	cfg.nshards = 1;
+	while ((opt = getopt_long(argc, argv, "n:f:l:p:DLjPT:U:t:d:c:i:rs:"
+				"mxa:q:v:ekuM:Sg:b:E:h",
+				magicsquare_longopts, NULL)) != -1) {
+		switch (opt) {
+		case 'n':
+			cfg.side = atoi(optarg);
+			break;
+		case 'f':
+			cfg.filterlevel = atoi(optarg);
+			break;
+		case 'l':
+			lines = magicsquare_parselines(optarg);
+			if (lines < 0) {
+				fprintf(stderr, "Invalid kinds of lines, they "
+					"must be magic, semi, pan or assoc\n");
+				return 1;
+			}
+			cfg.lines = lines;
+			break;
+		case 'p':
+			cfg.printstyle = atoi(optarg);
+			break;
+		case 'D':
+			cfg.dynamicorder = 1;
+			break;
+		case 'L':
+			cfg.linesets = 1;
+			break;
+		case 'j':
+			cfg.linepairs = 1;
+			break;
+		case 'P':
+			partial = 1;
+			break;
+		case 'T':
+			cfg.tailcells = atoi(optarg);
+			break;
+		case 'U':
+			socketpath = optarg;
+			break;
+		case 't':
+			cfg.nthreads = atoi(optarg);
+			break;
+		case 'd':
+			cfg.cutdepth = atoi(optarg);
+			break;
+		case 'c':
+			cfg.ckfile = optarg;
+			break;
+		case 'i':
+			cfg.ckinterval = atoi(optarg);
+			break;
+		case 'r':
+			cfg.resume = 1;
+			break;
+		case 's':
+			if (sscanf(optarg, "%d/%d", &cfg.shard, &cfg.nshards)
+					!= 2) {
+				cfg.nshards = 0;
+			}
+			break;
+		case 'm':
+			merge = 1;
+			break;
+		case 'x':
+			decode = 1;
+			break;
+		case 'a':
+			archive = optarg;
+			break;
+		case 'q':
+			query = optarg;
+			break;
+		case 'v':
+			validate = atoi(optarg);
+			if (validate < 1 || validate > 6) {
+				fprintf(stderr, "Invalid print style of the "
+					"input, it must be from 1 to 6\n");
+				return 1;
+			}
+			break;
+		case 'e':
+			mode = MAGSQ_EXPAND;
+			nmodes++;
+			break;
+		case 'k':
+			mode = MAGSQ_CANONICAL;
+			nmodes++;
+			break;
+		case 'u':
+			mode = MAGSQ_UNIQUE;
+			nmodes++;
+			break;
+		case 'M':
+			dedupmb = atoi(optarg);
+			break;
+		case 'S':
+			cfg.stats = 1;
+			break;
+		case 'g':
+			cfg.progress = atoi(optarg);
+			if (cfg.progress < 1) {
+				fprintf(stderr, "Invalid interval of the "
+					"progress, it must be at least 1\n");
+				return 1;
+			}
+			break;
+		case 'b':
+			benchmark = atoi(optarg);
+			if (benchmark < 1) {
+				fprintf(stderr, "Invalid number of repetitions "
+					"of the benchmark\n");
+				return 1;
+			}
+			break;
+		case 'E':
+			if (sscanf(optarg, "%d/%d", &nprobes, &nunitprobes) < 1
+					|| nprobes < 1 || nunitprobes < 0) {
+				fprintf(stderr, "Invalid number of probes\n");
+				return 1;
+			}
+			break;
+		case 'h':
+			magicsquare_usage(argv[0]);
+			return 0;
+		default:
+			magicsquare_usage(argv[0]);
+			return 1;
+		}
+	}
+	if (cfg.side < MAGSQ_MINSIDE || cfg.side > MAGSQ_MAXSIDE) {
+		fprintf(stderr, "Invalid size, it must be from %d to %d\n",
+			MAGSQ_MINSIDE, MAGSQ_MAXSIDE);
+		return 1;
+	}
+	if (cfg.filterlevel < 0 || cfg.filterlevel > 4) {
+		fprintf(stderr, "Invalid filter level, it must be from 0 "
+			"to 4\n");
+		return 1;
+	}
+	if (cfg.printstyle < 0 || cfg.printstyle > 6) {
+		fprintf(stderr, "Invalid print style, it must be from 0 "
+			"to 6\n");
+		return 1;
+	}
+	if (cfg.lines & SUMSQ_BROKEN && cfg.filterlevel > 2) {
+		fprintf(stderr, "Invalid filter level, the interchanges of "
+			"lines of -f 3 and 4 do not keep the broken "
+			"diagonals, use -f 2 or less\n");
+		return 1;
+	}
+	if (! (cfg.lines & SUMSQ_DIAGONALS) && (cfg.printstyle % 4 == 1
+					|| validate % 4 == 1)) {
+		fprintf(stderr, "Invalid print style, the short styles need "
+			"the diagonals\n");
+		return 1;
+	}
+	if (INCREMENTAL_CHECKS && SUMSQ_NLINES(cfg.side, cfg.lines) > 64) {
+		fprintf(stderr, "Too many lines for INCREMENTAL_CHECKS\n");
+		return 1;
+	}
+	if (cfg.nthreads < 1 || cfg.cutdepth < 1
+			|| cfg.cutdepth > cfg.side * cfg.side) {
+		fprintf(stderr, "Invalid number of threads or cut depth\n");
+		return 1;
+	}
+	if (cfg.ckfile && (cfg.nthreads > 1 || cfg.ckinterval < 1)) {
+		fprintf(stderr, "Checkpoints need one thread and an "
+			"interval\n");
+		return 1;
+	}
+	if (cfg.resume && ! cfg.ckfile) {
+		fprintf(stderr, "Resuming needs a checkpoint file\n");
+		return 1;
+	}
+	if (cfg.nshards < 1 || cfg.shard < 0 || cfg.shard >= cfg.nshards) {
+		fprintf(stderr, "Invalid shard, it must be K/M with K < M\n");
+		return 1;
+	}
+	if (nmodes && ! validate) {
+		fprintf(stderr, "Expanding or finding the equivalent squares "
+			"needs the style of the input\n");
+		return 1;
+	}
+	if (nmodes > 1 || dedupmb < 1) {
+		fprintf(stderr, "Invalid options, only one of -e, -k and -u "
+			"and at least 1 megabyte\n");
+		return 1;
+	}
+	if (archive && cfg.printstyle == 0) {
+		fprintf(stderr, "Archiving needs the print style of the "
+			"squares\n");
+		return 1;
+	}
+	if (benchmark) {
+		return ! magicsquare_benchmark(&cfg, benchmark);
+	}
+	if (nprobes) {
+		return ! magicsquare_estimate(&cfg, nprobes, nunitprobes);
+	}
+	if (socketpath) {
+		return ! magicsquare_serve(&cfg, socketpath);
+	}
+	if (partial) {
+		return ! magicsquare_complete(&cfg);
+	}
+	if (validate) {
+		return ! magicsquare_validate(&cfg, validate, mode, dedupmb);
+	}
+	if (query) {
+		return ! magicsquare_query(&cfg, query);
+	}
+	if (archive) {
+		return ! magicsquare_pack(&cfg, archive, argc - optind,
+					argv + optind);
+	}
+	if (decode) {
+		return ! magicsquare_decode(&cfg, argc - optind, argv + optind);
+	}
+	if (merge) {
+		return ! magicsquare_merge(&cfg, argc - optind, argv + optind);
+	}
+	return ! magicsquare_generate(&cfg);
+}
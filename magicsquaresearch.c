@@ -0,0 +1,703 @@
+/**
+ * magicsquaresearch - Functions of the search of the magic squares that are
+ * run for each number tried, included by magicsquare.c once for each size
+ * specialized with MAGSQ_KSIDE defined to it, so the compiler can use that size
+ * as a constant to unroll the loops over the lines and avoid the divisions, and
+ * once without it for the squares of any size. The names of the functions end
+ * with the size or with "any", as MAGSQ_K(name) returns them, and the macro
+ * MAGSQ_KSIDE is undefined at the end to include this file again. The
+ * functions of each size are only used with the lines of the magic squares,
+ * and the ones of any size read the sum of each line from the square.
+ *
+ * Copyright 2021 Carlos Rica (jasampler)
+ * This file is part of the jasampler's magic-square project.
+ */
+#ifdef MAGSQ_KSIDE
+#define MAGSQ_KSUFFIX MAGSQ_KSIDE
+#define MAGSQ_KSIDEOF(sq) MAGSQ_KSIDE
+#define MAGSQ_KNLINES(sq) (SUMSQ_SIDE2(MAGSQ_KSIDE) + 2)
+#define MAGSQ_KSETNUM(sq, c, n) sumsquare_setnumside(sq, c, n, MAGSQ_KSIDE)
+#define MAGSQ_KMAGICLINES(sq) 1
+#define MAGSQ_KLINEMSUM(sq, l) \
+	(MAGSQ_KSIDE * (MAGSQ_KSIDE * MAGSQ_KSIDE + 1) / 2)
+#else
+#define MAGSQ_KSUFFIX any
+#define MAGSQ_KSIDEOF(sq) sumsquare_side(sq)
+#define MAGSQ_KNLINES(sq) sumsquare_nlines(sq)
+#define MAGSQ_KSETNUM(sq, c, n) sumsquare_setnum(sq, c, n)
+#define MAGSQ_KMAGICLINES(sq) (sumsquare_lines(sq) == SUMSQ_MAGICLINES)
+#define MAGSQ_KLINEMSUM(sq, l) sumsquare_linemsum(sq, l)
+#endif
+#define MAGSQ_KNAME(name, suffix) magicsquare_##name##_##suffix
+#define MAGSQ_KEXPAND(name, suffix) MAGSQ_KNAME(name, suffix)
+#define MAGSQ_K(name) MAGSQ_KEXPAND(name, MAGSQ_KSUFFIX)
+
+#if INCREMENTAL_CHECKS
+/** Returns if the available numbers could fill the holes of each line to get
+ * the magic sum by adding to them the current minimum and maximum sums, after
+ * writing the last removed number in the given cell of a square that passed
+ * these checks before, with the given mask of lines with only one hole. Only
+ * the lines of the cell are fully checked again, the other lines with one hole
+ * are checked only if they needed that number and the other lines with more
+ * holes only if the sums used by them changed with the number removed.
+ * Saves in the given addresses the new mask of lines with only one hole and
+ * the index of the first one as candidate to be filled, or -1 if none, and
+ * counts in prunes the reason to fail. */
+char MAGSQ_K(checksums)(sumsquare sq, sortednlist nl, sortednlistsums sm,
+		int cellidx, unsigned long long oneholes,
+		unsigned long long *poneholes, int *pln1hole,
+		unsigned long long *prunes) {
+	int c, l, holes, nlines = MAGSQ_KNLINES(sq);
+	int num = sumsquare_getnum(sq, cellidx);
+	int chg = sm->minchg < sm->maxchg ? sm->minchg : sm->maxchg;
+	unsigned long long celllines = 0, mask;
+	sumsquare_cellrelation cell = sumsquare_getcellrelation(sq, cellidx);
+	char r = 1;
+	for (c = 0; r && c < cell.ncelllines; c++) {
+		l = cell.celllines[c];
+		celllines |= MAGSQ_LINEBIT(l);
+		r = magicsquare_checkline(sq, nl, sm,
+				MAGSQ_KLINEMSUM(sq, l), l, prunes);
+		if (sumsquare_getlinecount(sq, l).holes == 1) {
+			oneholes |= MAGSQ_LINEBIT(l);
+		} else {
+			oneholes &= ~MAGSQ_LINEBIT(l);
+		}
+	}
+	for (mask = oneholes & ~celllines; r && mask; mask &= mask - 1) {
+		l = __builtin_ctzll(mask);
+		if (MAGSQ_KLINEMSUM(sq, l)
+				- sumsquare_getlinecount(sq, l).sum == num) {
+#if PRINT_CHECKS
+printf("INVALID sum=%d holes=1 notavailable=%d\n",
+	sumsquare_getlinecount(sq, l).sum, num);
+magicsquare_printchecks(nl, sm, sq);
+#endif
+			prunes[MAGSQ_NOTAVAILABLE]++;
+			r = 0;
+		}
+	}
+	for (l = 0; r && chg < sm->size && l < nlines; l++) {
+		holes = sumsquare_getlinecount(sq, l).holes;
+		if (holes > 1 && holes > chg
+				&& ! (celllines & MAGSQ_LINEBIT(l))) {
+			r = magicsquare_checkline(sq, nl, sm,
+				MAGSQ_KLINEMSUM(sq, l), l, prunes);
+		}
+	}
+#if PRINT_CHECKS
+if (r) {
+	printf("OK!\n");
+	magicsquare_printchecks(nl, sm, sq);
+}
+#endif
+	*poneholes = oneholes;
+	*pln1hole = r && oneholes ? __builtin_ctzll(oneholes) : -1;
+	return r;
+}
+#else
+/** Returns if the available numbers could fill the holes of each line to get
+ * the magic sum by adding to them the current minimum and maximum sums, and
+ * also saves in the given address the index of the first line found with only
+ * one hole as candidate to be filled, or -1 if there is no lines with holes,
+ * counting in prunes the reason to fail.
+ * Without INCREMENTAL_CHECKS the sums are calculated again for each call and
+ * all the lines are checked, ignoring the given cell and mask of lines. The
+ * full lines are checked with the same sums, since the sums of 0 holes are 0,
+ * and the loop stops at the first line that fails, what most lines do. */
+char MAGSQ_K(checksums)(sumsquare sq, sortednlist nl, sortednlistsums sm,
+		int cellidx, unsigned long long oneholes,
+		unsigned long long *poneholes, int *pln1hole,
+		unsigned long long *prunes) {
+	int l, sum, holes, linemsum, nlines = MAGSQ_KNLINES(sq), ln1hole = -1;
+	const SUMSQ_SUMTYPE *sums = sq->linesums, *lineholes = sq->lineholes;
+	int *minsums, *maxsums;
+	char r = 1;
+	(void) cellidx;
+	(void) oneholes;
+	(void) poneholes;
+	sortednlistsums_getsize(sm, nl, MAGSQ_KSIDEOF(sq));
+	minsums = sm->minsums;
+	maxsums = sm->maxsums;
+	for (l = 0; l < nlines; l++) {
+		sum = sums[l];
+		holes = lineholes[l];
+		linemsum = MAGSQ_KLINEMSUM(sq, l);
+		assert(holes <= sm->len);
+		if (sum + minsums[holes - 1] > linemsum) {
+			prunes[holes ? MAGSQ_MINSUM : MAGSQ_FULLLINE]++;
+			r = 0;
+		} else if (sum + maxsums[holes - 1] < linemsum) {
+			prunes[holes ? MAGSQ_MAXSUM : MAGSQ_FULLLINE]++;
+			r = 0;
+		} else if (holes == 1) {
+			if (sortednlist_isremoved(nl, linemsum - sum)) {
+				prunes[MAGSQ_NOTAVAILABLE]++;
+				r = 0;
+			} else if (ln1hole < 0) {
+				ln1hole = l;
+			}
+		}
+		if (! r) {
+#if PRINT_CHECKS
+printf("INVALID line=%d sum=%d holes=%d\n", l, sum, holes);
+magicsquare_printchecks(nl, sm, sq);
+#endif
+			break;
+		}
+	}
+#if PRINT_CHECKS
+if (r) {
+	printf("OK!\n");
+	magicsquare_printchecks(nl, sm, sq);
+}
+#endif
+	*pln1hole = r ? ln1hole : -1;
+	return r;
+}
+#endif
+
+/** Returns if each line of the given cell with at least two numbers and two
+ * holes can still be completed to one of the sets of numbers of the table of
+ * the state using only available numbers, counting in prunes the reason to
+ * fail otherwise. Only the lines of the cell written are checked, since
+ * checking all the lines after each number discards more numbers but it takes
+ * more time than it saves, and only the lines of N cells, not the pairs. */
+char MAGSQ_K(checksets)(magicsquare ms, int cellidx,
+			unsigned long long *prunes) {
+	sumsquare sq = ms->sq;
+	sumsquare_cellrelation cell = sumsquare_getcellrelation(sq, cellidx);
+	int c, l, k, n, holes, side = MAGSQ_KSIDEOF(sq);
+	unsigned long long line, available = ~ms->usednums;
+	SUMSQ_NUMTYPE *cells;
+	for (c = 0; c < cell.ncelllines; c++) {
+		l = cell.celllines[c];
+		holes = sumsquare_getlinecount(sq, l).holes;
+		if (holes < 2 || holes > side - 2
+			|| sumsquare_getlinerelation(sq, l).nlinecells
+				!= side) {
+			continue;
+		}
+		cells = sumsquare_getlinerelation(sq, l).linecells;
+		for (line = 0, k = 0; k < side; k++) {
+			n = sumsquare_getnum(sq, cells[k]);
+			if (n) {
+				line |= MAGSQ_NUMBIT(n);
+			}
+		}
+		if (! sumsets_canfill(ms->sets, __builtin_ctzll(line) + 1,
+				__builtin_ctzll(line & (line - 1)) + 1, line,
+				available)) {
+			prunes[MAGSQ_NOSUMSET]++;
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/** Returns if each pair of lines with holes, one of them a line of the given
+ * cell, could be completed together to get the magic sum in both with the
+ * available numbers, counting in prunes the reason to fail otherwise. The
+ * holes of two lines need different numbers except the cells that they share,
+ * whose numbers are added to both, so the sum missing in the two lines must be
+ * between the sums of the first and last available numbers for all their
+ * holes, plus the first or last numbers once more for the shared holes, one
+ * at most with the lines of the magic squares. Only the
+ * pairs with at most N holes are checked, using the sums of the state already
+ * calculated by checksums, since calculating more sums takes more time than
+ * the few numbers that they discard. */
+char MAGSQ_K(checkpairs)(magicsquare ms, int cellidx,
+			unsigned long long *prunes) {
+	sumsquare sq = ms->sq;
+	sumsquare_cellrelation cell = sumsquare_getcellrelation(sq, cellidx);
+	int side = MAGSQ_KSIDEOF(sq), nlines = MAGSQ_KNLINES(sq);
+	int *minsums = ms->sm->minsums, *maxsums = ms->sm->maxsums;
+	int c, l1, l2, cross, holes, shared, missing;
+	sumsquare_linecount line1, line2;
+	for (c = 0; c < cell.ncelllines; c++) {
+		l1 = cell.celllines[c];
+		line1 = sumsquare_getlinecount(sq, l1);
+		if (line1.holes == 0) {
+			continue;
+		}
+		for (l2 = 0; l2 < nlines; l2++) {
+			line2 = sumsquare_getlinecount(sq, l2);
+			if (line2.holes == 0 || l2 == l1) {
+				continue;
+			}
+			if (MAGSQ_KMAGICLINES(sq)) {
+				cross = l1 < l2
+					? magicsquare_crosscell(side, l1, l2)
+					: magicsquare_crosscell(side, l2, l1);
+				shared = cross >= 0
+					&& sumsquare_getnum(sq, cross) == 0;
+			} else {
+				shared = magicsquare_sharedholes(sq, l1, l2);
+			}
+			missing = MAGSQ_KLINEMSUM(sq, l1)
+				+ MAGSQ_KLINEMSUM(sq, l2)
+				- line1.sum - line2.sum;
+			holes = line1.holes + line2.holes - shared;
+			if (holes > ms->sm->len) {
+				continue;
+			}
+			if (missing < minsums[shared - 1] + minsums[holes - 1]
+				|| missing > maxsums[shared - 1]
+						+ maxsums[holes - 1]) {
+				prunes[MAGSQ_LINEPAIR]++;
+				return 0;
+			}
+		}
+	}
+	return 1;
+}
+
+/** Inserts the given number as a derived number in the given position.
+ * A derived number is added when no other number can be in that position,
+ * and they must be removed cleanly in the same way that they were added. */
+void MAGSQ_K(insertderivednum)(magicsquare ms, int pos, int num) {
+	sumsquare sq = ms->sq;
+	sortednlist pl = ms->pl;
+	char *numtypes = ms->numtypes;
+#if PRINT_CHECKS
+printf("INSERT DERIVED pos=%d num=%d\n", pos, num);
+#endif
+	assert(numtypes[pos - 1] == MAGSQ_EMPTYPOS);
+	assert(! sumsquare_getnum(sq, pos - 1));
+	assert(! sortednlist_isremoved(ms->nl, num));
+	assert(! sortednlist_isremoved(pl, pos));
+	magicsquare_removenum(ms, num);
+	MAGSQ_KSETNUM(sq, pos - 1, num);
+	numtypes[pos - 1] = MAGSQ_DERIVEDNUM;
+	sortednlist_remove(pl, pos);
+}
+
+/** Removes the number in the given position marked as a derived number.
+ * A derived number is added when no other number can be in that position,
+ * and they must be removed cleanly in the same way that they were added. */
+void MAGSQ_K(removederivednum)(magicsquare ms, int pos) {
+	sumsquare sq = ms->sq;
+	sortednlist pl = ms->pl;
+	char *numtypes = ms->numtypes;
+#if PRINT_CHECKS
+printf("REMOVE DERIVED pos=%d num=%d\n", pos, sumsquare_getnum(sq, pos - 1));
+#endif
+	assert(numtypes[pos - 1] == MAGSQ_DERIVEDNUM);
+	assert(sumsquare_getnum(sq, pos - 1));
+	assert(sortednlist_nremoved(ms->nl));
+	assert(sortednlist_lastremoved(ms->nl)
+		== sumsquare_getnum(sq, pos - 1));
+	assert(sortednlist_nremoved(pl));
+	assert(pos == sortednlist_lastremoved(pl));
+	magicsquare_restorenum(ms);
+	MAGSQ_KSETNUM(sq, pos - 1, 0);
+	numtypes[pos - 1] = MAGSQ_EMPTYPOS;
+	sortednlist_restore(pl);
+}
+
+/** Finds and returns the next available number for the given position, being
+ * zero if there is not an available number for that position, and writes it in
+ * the square updating the list of available numbers and positions. */
+int MAGSQ_K(setnext)(magicsquare ms, int pos) {
+	sumsquare sq = ms->sq;
+	sortednlist nl = ms->nl, pl = ms->pl;
+	char *numtypes = ms->numtypes;
+	int oldnum, num;
+	if (numtypes[pos - 1] == MAGSQ_DERIVEDNUM) {
+		MAGSQ_K(removederivednum)(ms, pos);
+		return 0;
+	}
+	oldnum = sumsquare_getnum(sq, pos - 1);
+	if (oldnum) {
+		assert(oldnum == sortednlist_lastremoved(nl));
+		magicsquare_restorenum(ms);
+	}
+	num = sortednlist_next(nl, oldnum);
+	if (num) {
+		magicsquare_removenum(ms, num);
+		if (! oldnum) {
+			assert(numtypes[pos - 1] == MAGSQ_EMPTYPOS);
+			assert(! sortednlist_isremoved(pl, pos));
+			sortednlist_remove(pl, pos);
+			numtypes[pos - 1] = MAGSQ_TRIEDNUM;
+			ms->ntried++;
+		}
+	} else if (oldnum) {
+		assert(numtypes[pos - 1] == MAGSQ_TRIEDNUM);
+		assert(pos == sortednlist_lastremoved(pl));
+		sortednlist_restore(pl);
+		numtypes[pos - 1] = MAGSQ_EMPTYPOS;
+		ms->ntried--;
+	}
+	MAGSQ_KSETNUM(sq, pos - 1, num);
+	return num;
+}
+
+/** Returns the next empty position to try, or 0 if there is none. It is the
+ * first one in the order of the positions while any of the positions read by
+ * magicsquare_checkequiv is empty, so the squares are filtered early, and also
+ * after them without a dynamic order. With a dynamic order it is the empty
+ * position whose lines leave the narrowest range of numbers for it, using the
+ * sums of the available numbers, or the first one of them in the order. */
+int MAGSQ_K(nextpos)(magicsquare ms) {
+	sumsquare sq = ms->sq;
+	sortednlist pl = ms->pl;
+	int side = MAGSQ_KSIDEOF(sq), last = side - 1, msum = ms->msum;
+	int pos = sortednlist_first(pl), best = pos, bestwidth;
+	int i, j, c, l, lo, hi;
+	sumsquare_cellrelation cell;
+	if (! ms->dynamicorder || pos == 0
+			|| MAGSQ_ISEQUIVCELL(pos - 1, side, last)) {
+		return pos;
+	}
+	bestwidth = side * side;
+	for (; pos; pos = sortednlist_next(pl, pos)) {
+		i = SUMSQ_IFROMPOS(pos - 1, side);
+		j = SUMSQ_JFROMPOS(pos - 1, side);
+		lo = 1;
+		hi = side * side;
+		if (MAGSQ_KMAGICLINES(sq)) {
+			magicsquare_narrow(sq, ms->sm, msum, i, &lo, &hi);
+			magicsquare_narrow(sq, ms->sm, msum, side + j, &lo,&hi);
+			if (i == j) {
+				magicsquare_narrow(sq, ms->sm, msum,
+						SUMSQ_SIDE2(side), &lo, &hi);
+			}
+			if (i + j == last) {
+				magicsquare_narrow(sq, ms->sm, msum,
+					SUMSQ_SIDE2(side) + 1, &lo, &hi);
+			}
+		} else {
+			cell = sumsquare_getcellrelation(sq, pos - 1);
+			for (c = 0; c < cell.ncelllines; c++) {
+				l = cell.celllines[c];
+				magicsquare_narrow(sq, ms->sm,
+					MAGSQ_KLINEMSUM(sq, l), l,
+					&lo, &hi);
+			}
+		}
+		if (hi - lo < bestwidth) {
+			best = pos;
+			bestwidth = hi - lo;
+			if (bestwidth <= 0) {
+				break;
+			}
+		}
+	}
+	return best;
+}
+
+/* returns if the given available number can be written in the given empty
+ * cell leaving each line of the cell with its magic sum when full, with an
+ * available number when it has one hole and with a sum between the sums of the
+ * first and last available numbers for its holes otherwise */
+static char MAGSQ_K(tailfits)(sumsquare sq, sortednlist nl, int cellidx,
+				int num) {
+	sumsquare_cellrelation cell = sumsquare_getcellrelation(sq, cellidx);
+	sumsquare_linecount line;
+	int c, k, n, rest, linemsum;
+	int ncells = MAGSQ_KSIDEOF(sq) * MAGSQ_KSIDEOF(sq);
+	for (c = 0; c < cell.ncelllines; c++) {
+		line = sumsquare_getlinecount(sq, cell.celllines[c]);
+		linemsum = MAGSQ_KLINEMSUM(sq, cell.celllines[c]);
+		rest = linemsum - line.sum - num;
+		line.holes--;
+		if (line.holes == 0) {
+			if (rest != 0) {
+				return 0;
+			}
+		} else if (line.holes == 1) {
+			if (rest < 1 || rest > ncells || rest == num
+					|| sortednlist_isremoved(nl, rest)) {
+				return 0;
+			}
+		} else {
+			for (k = 0, n = sortednlist_first(nl); k < line.holes;
+					n = sortednlist_next(nl, n)) {
+				if (n != num) {
+					rest -= n;
+					k++;
+				}
+			}
+			if (rest < 0) {
+				return 0;
+			}
+			rest = linemsum - line.sum - num;
+			for (k = 0, n = sortednlist_last(nl); k < line.holes;
+					n = sortednlist_prev(nl, n)) {
+				if (n != num) {
+					rest -= n;
+					k++;
+				}
+			}
+			if (rest > 0) {
+				return 0;
+			}
+		}
+	}
+	return 1;
+}
+
+/** Returns the number of magic squares that complete the square of the state
+ * and pass the filter level, for the counts without printing the squares near
+ * the end of the search. It writes the numbers of the empty positions directly
+ * in the square and the lists, without the stack of the state, the sums of the
+ * available numbers or the statistics, filling first the derived numbers and
+ * checking only the lines of each cell written, and restores them at the
+ * end. */
+unsigned long MAGSQ_K(counttail)(magicsquare ms) {
+	sumsquare sq = ms->sq;
+	sortednlist nl = ms->nl, pl = ms->pl;
+	int l, num, pos = sortednlist_first(pl);
+	int nlines = MAGSQ_KNLINES(sq), derived = 0;
+	unsigned long count = 0;
+	if (pos == 0) {
+		return magicsquare_checkequiv(sq, ms->filterlevel);
+	}
+	for (l = 0; ms->fillderived && l < nlines; l++) {
+		if (sumsquare_getlinecount(sq, l).holes == 1) {
+			pos = sumsquare_emptycell(sq, l) + 1;
+			derived = MAGSQ_KLINEMSUM(sq, l)
+				- sumsquare_getlinecount(sq, l).sum;
+			if (sortednlist_isremoved(nl, derived)) {
+				return 0;
+			}
+			break;
+		}
+	}
+	num = derived ? derived : sortednlist_first(nl);
+	for (; num; num = derived ? 0 : sortednlist_next(nl, num)) {
+		if (MAGSQ_K(tailfits)(sq, nl, pos - 1, num)) {
+			sortednlist_remove(nl, num);
+			sortednlist_remove(pl, pos);
+			MAGSQ_KSETNUM(sq, pos - 1, num);
+			count += MAGSQ_K(counttail)(ms);
+			MAGSQ_KSETNUM(sq, pos - 1, 0);
+			sortednlist_restore(pl);
+			sortednlist_restore(nl);
+		}
+	}
+	return count;
+}
+
+/** Returns if the number written in the given position passes all the checks
+ * of the search, counting the reason to fail in the statistics of the state,
+ * and saves the line with one hole to fill as MAGSQ_K(checksums). */
+static inline char MAGSQ_K(checknode)(magicsquare ms, int pos, int *pln1hole){
+	unsigned long long *prunes = ms->stats.prunes;
+	return MAGSQ_K(checksums)(ms->sq, ms->nl, ms->sm, pos - 1,
+#if INCREMENTAL_CHECKS
+				ms->oneholes[sortednlist_nremoved(ms->pl) - 1],
+				ms->oneholes + sortednlist_nremoved(ms->pl),
+#else
+				0, NULL,
+#endif
+				pln1hole, prunes)
+		&& magicsquare_countequiv(ms->sq, ms->filterlevel, prunes)
+		&& (! ms->sets || MAGSQ_K(checksets)(ms, pos - 1, prunes))
+		&& (! ms->linepairs
+			|| MAGSQ_K(checkpairs)(ms, pos - 1, prunes));
+}
+
+/** Checks the number written in the given position as the search does, filling
+ * the derived numbers while they pass the checks and adding them to the given
+ * count, and returns the next empty position to try, 0 if the square is
+ * complete, MAGSQ_FAILED if the number does not pass the checks or
+ * MAGSQ_DERIVEDFAILED if a derived number does not. The derived numbers must
+ * be removed with MAGSQ_K(unfill). */
+int MAGSQ_K(expand)(magicsquare ms, int pos, unsigned long long *pnderived) {
+	sumsquare sq = ms->sq;
+	int ln1hole, auxpos, r = MAGSQ_FAILED;
+	while (MAGSQ_K(checknode)(ms, pos, &ln1hole)) {
+		auxpos = MAGSQ_K(nextpos)(ms);
+		if (auxpos == 0 || ! ms->fillderived || ln1hole < 0) {
+			return auxpos;
+		}
+		pos = sumsquare_emptycell(sq, ln1hole) + 1;
+		MAGSQ_K(insertderivednum)(ms, pos,
+			MAGSQ_KLINEMSUM(sq, ln1hole)
+			- sumsquare_getlinecount(sq, ln1hole).sum);
+		(*pnderived)++;
+		r = MAGSQ_DERIVEDFAILED;
+	}
+	return r;
+}
+
+/** Removes the derived numbers written after the number of the given position,
+ * the last tried one. */
+void MAGSQ_K(unfill)(magicsquare ms, int pos) {
+	int last;
+	while ((last = sortednlist_lastremoved(ms->pl)) != pos) {
+		MAGSQ_K(removederivednum)(ms, last);
+	}
+}
+
+/** Tries all the available numbers in the given position, adding to the given
+ * counts the numbers written and the squares found multiplied by the given
+ * weight, and writes then with the given generator one of the numbers that
+ * pass the checks and leave empty positions, multiplying the weight by the
+ * number of choices. Returns the next position to try after the chosen number
+ * and its derived numbers, or 0 if there was no choice. The counts of the
+ * steps of a random path to a leaf estimate the nodes and the squares of the
+ * tree below the first position (the estimator of Knuth), with the nodes
+ * counted as the search without the tail counts them. */
+int MAGSQ_K(probestep)(magicsquare ms, int pos, unsigned long long *rng,
+			double *pweight, double *pnodes, double *psquares) {
+	int num, chosen = 0, next;
+	unsigned long nchoices = 0;
+	unsigned long long nwritten = 0;
+	while ((num = MAGSQ_K(setnext)(ms, pos))) {
+		nwritten++;
+		next = MAGSQ_K(expand)(ms, pos, &nwritten);
+		if (next == 0) {
+			*psquares += *pweight;
+		} else if (next > 0
+			&& magicsquare_random(rng, ++nchoices) == 0) {
+			chosen = num;
+		}
+		MAGSQ_K(unfill)(ms, pos);
+	}
+	*pnodes += *pweight * nwritten;
+	if (nchoices == 0) {
+		return 0;
+	}
+	*pweight *= nchoices;
+	while (MAGSQ_K(setnext)(ms, pos) != chosen) {
+	}
+	return MAGSQ_K(expand)(ms, pos, &nwritten);
+}
+
+/** Adds to the given counts the estimates of a random path from the position
+ * of the state to a leaf, restoring the state at the end. With tail cells,
+ * the squares are counted exactly with MAGSQ_K(counttail) at the first node
+ * with tailcells empty positions or less, multiplied by its weight, what
+ * makes the estimate of the squares much more precise, and the path follows
+ * only to estimate the nodes. */
+void MAGSQ_K(probe)(magicsquare ms, unsigned long long *rng, double *pnodes,
+			double *psquares) {
+	sortednlist pl = ms->pl;
+	int pos = ms->pos, base = sortednlist_nremoved(pl);
+	int ncells = sumsquare_ncells(ms->sq);
+	double weight = 1, tailsquares = 0, *pstepsquares = psquares;
+	while (pos) {
+		if (pstepsquares == psquares && ms->tailcells
+			&& ncells - sortednlist_nremoved(pl) <= ms->tailcells) {
+			*psquares += weight * MAGSQ_K(counttail)(ms);
+			pstepsquares = &tailsquares;
+		}
+		pos = MAGSQ_K(probestep)(ms, pos, rng, &weight, pnodes,
+						pstepsquares);
+	}
+	while (sortednlist_nremoved(pl) > base) {
+		magicsquare_pop(ms);
+	}
+}
+
+/** Follows random paths from the position of the state with probestep, with
+ * every node written counted once, until the paths add no nodes or add up to
+ * MAGSQ_CALIBRATIONTOTAL nodes, restoring the state after each path. Returns
+ * the number of nodes written. */
+double MAGSQ_K(calibrate)(magicsquare ms, unsigned long long *rng) {
+	sortednlist pl = ms->pl;
+	int pos, base = sortednlist_nremoved(pl);
+	double weight, nodes = 0, prev, squares = 0;
+	do {
+		prev = nodes;
+		for (pos = ms->pos; pos; pos = MAGSQ_K(probestep)(ms, pos,
+					rng, &weight, &nodes, &squares)) {
+			weight = 1;
+		}
+		while (sortednlist_nremoved(pl) > base) {
+			magicsquare_pop(ms);
+		}
+	} while (nodes > prev && nodes < MAGSQ_CALIBRATIONTOTAL);
+	return nodes;
+}
+
+/** Searches all the magic squares from the current position of the state,
+ * counting them and printing them, until all the positions are restored,
+ * and adding to the state the calls to setnext and to its statistics the
+ * numbers written and discarded.
+ * With a cut depth, the subtrees not claimed by this state are skipped when
+ * trying the number cutdepth, and also the squares completed before it.
+ * In the counts without printing, the squares are counted with counttail when
+ * the empty positions are tailcells or less, after the cut depth.
+ * The requests of idle states and the signals are handled before trying each
+ * number, returning 0 if the search was stopped by a signal and 1 otherwise. */
+char MAGSQ_K(search)(magicsquare ms) {
+	sumsquare sq = ms->sq;
+	sortednlist pl = ms->pl;
+	magicsquare_stats *stats = &ms->stats;
+	int pos = ms->pos, auxpos, ln1hole;
+	char fillderived = ms->fillderived;
+	char cut, done = 1;
+	unsigned long long nsetnext = 0;
+	while (1) {
+		if (atomic_load_explicit(&ms->stealreq, memory_order_relaxed)
+				> MAGSQ_NOREQUEST) {
+			magicsquare_givework(ms, pos);
+		}
+		if (magicsquare_signaled
+				&& ! magicsquare_handlesignals(ms, pos)) {
+			done = 0;
+			break;
+		}
+		nsetnext++;
+		if (MAGSQ_K(setnext)(ms, pos)) {
+			stats->depthnodes[sortednlist_nremoved(pl)]++;
+			stats->posnodes[pos - 1]++;
+			cut = ms->ntried == ms->cutdepth;
+			while (MAGSQ_K(checknode)(ms, pos, &ln1hole)) {
+				if (cut) {
+					cut = 0;
+					if (! magicsquare_claimunit(ms)) {
+						break;
+					}
+				}
+				if (ms->tailcells && ms->ntried >= ms->cutdepth
+						&& sumsquare_ncells(sq)
+						- sortednlist_nremoved(pl)
+						<= ms->tailcells) {
+					ms->cricount += MAGSQ_K(counttail)(ms);
+					break;
+				}
+				auxpos = MAGSQ_K(nextpos)(ms);
+				if (auxpos == 0) {
+					if (ms->ntried >= ms->cutdepth
+						|| magicsquare_claimunit(ms)) {
+						magicsquare_found(ms);
+					}
+					break;
+				} else if (fillderived && ln1hole > -1) {
+					pos = sumsquare_emptycell(sq,ln1hole)+1;
+					MAGSQ_K(insertderivednum)(ms, pos,
+				MAGSQ_KLINEMSUM(sq, ln1hole)
+				- sumsquare_getlinecount(sq, ln1hole).sum);
+					stats->nderived++;
+					stats->depthnodes[
+						sortednlist_nremoved(pl)]++;
+					stats->posnodes[pos - 1]++;
+				} else {
+					pos = auxpos;
+					break;
+				}
+			}
+		} else if ((pos = magicsquare_backtrack(ms)) == 0) {
+			break;
+		}
+	}
+	ms->pos = pos;
+	ms->nsetnext += nsetnext;
+	return done;
+}
+
+#undef MAGSQ_K
+#undef MAGSQ_KEXPAND
+#undef MAGSQ_KNAME
+#undef MAGSQ_KSETNUM
+#undef MAGSQ_KMAGICLINES
+#undef MAGSQ_KLINEMSUM
+#undef MAGSQ_KNLINES
+#undef MAGSQ_KSIDEOF
+#undef MAGSQ_KSUFFIX
+#undef MAGSQ_KSIDE
@@ -67,6 +67,10 @@ sortednlist sortednlist_init(char *mem, SORTNL_TYPE size) {
 /** Returns the last removed number in the stack, which must not be empty. */
 #define sortednlist_lastremoved(l) ((l)->stack[(l)->nremoved - 1])
 
+/** Returns the number removed in the given index of the stack, being 0 the
+ * index of the first removed number and nremoved - 1 the index of the last. */
+#define sortednlist_removed(l, i) ((l)->stack[i])
+
 /** Returns the first number currently not removed and the smallest one. */
 #define sortednlist_first(l) ((l)->elems[0].next)
 
@@ -82,6 +86,24 @@ sortednlist sortednlist_init(char *mem, SORTNL_TYPE size) {
 /** Returns 0 when the given number does not have a previous number. */
 #define sortednlist_prev(l, n) ((l)->elems[SORTNL_INDEX(n)].prev)
 
+/** Saves in the given arrays the partial sums of the first and the last numbers
+ * currently not removed, being the index 0 the first/last number, the index 1
+ * the sum of the 2 first/last numbers, and so on, up to the given number of
+ * sums, returning the number of sums saved in each array. */
+int sortednlist_getsums(sortednlist nl, int *minsums, int *maxsums, int nsums){
+	int k, min = sortednlist_first(nl), max = sortednlist_last(nl);
+	int minsum = 0, maxsum = 0;
+	for (k = 0; k < nsums && min; k++) {
+		minsum += min;
+		maxsum += max;
+		minsums[k] = minsum;
+		maxsums[k] = maxsum;
+		min = sortednlist_next(nl, min);
+		max = sortednlist_prev(nl, max);
+	}
+	return k;
+}
+
 /** Moves a given number to be after another given number changing the order of
  * the list but without changing the direct access to the elements by number.
  * Returns 0 if the stack of removed numbers is not empty.
@@ -0,0 +1,208 @@
+/**
+ * sortednlistbits - Alternative implementation of the sortednlist with the
+ * same interface, that stores the numbers not removed as bits of an array of
+ * 64-bit words instead of a double-linked list, so the next and previous
+ * numbers are found counting the trailing or leading zeros of the words
+ * instead of following cursors. Each number has a rank that is its bit in the
+ * words and the order of the list, that only changes when numbers are moved.
+ * To create a list of numbers 1 to N, a char array of size SORTEDNLIST_BYTES(N)
+ * must be initialized by calling to sortednlist_init(array, N) which returns
+ * the same array of type sortednlist. The list can be reordered by moving
+ * numbers when there are not removed ones.
+ *
+ * Copyright 2021 Carlos Rica (jasampler)
+ * This file is part of the jasampler's magic-square project.
+ */
+#include <assert.h>
+
+/* unsigned char supports a maximum of N=255 */
+#define SORTNL_TYPE unsigned char
+#define SORTNL_INDEX(idx) ((int) idx)
+#define SORTNLBITS_WORD unsigned long long
+#define SORTNLBITS_NWORDS(size) (SORTNL_INDEX(size) / 64 + 1)
+
+typedef struct sortednlist_st {
+	SORTNL_TYPE size, nremoved, *stack, *ranks, *nums;
+	SORTNLBITS_WORD *bits;
+} *sortednlist;
+
+#define SORTEDNLIST_BYTES(size) \
+	(sizeof(struct sortednlist_st) \
+		+ (SORTNLBITS_NWORDS(size) * sizeof(SORTNLBITS_WORD)) \
+		+ ((size) * sizeof(SORTNL_TYPE)) \
+		+ (((size) + 1) * 2 * sizeof(SORTNL_TYPE)))
+
+/** Must receive as arguments an array of SORTNL_TYPE(N) bytes and the same
+ * number N, and it returns the same array initalized as a sortednlist list. */
+sortednlist sortednlist_init(char *mem, SORTNL_TYPE size) {
+	int i;
+	sortednlist nl = (sortednlist) mem;
+	SORTNLBITS_WORD *bits = (SORTNLBITS_WORD *) (nl + 1);
+	SORTNL_TYPE *stack = (SORTNL_TYPE *) (bits + SORTNLBITS_NWORDS(size));
+	nl->size = size;
+	nl->nremoved = 0;
+	nl->stack = stack;
+	nl->ranks = stack + size;
+	nl->nums = nl->ranks + size + 1;
+	nl->bits = bits;
+	for (i = 0; i < SORTNLBITS_NWORDS(size); i++) {
+		bits[i] = 0;
+	}
+	for (i = 0; i <= size; i++) { /* the bit 0 is never set */
+		nl->ranks[i] = i;
+		nl->nums[i] = i;
+		if (i) {
+			bits[i / 64] |= 1ULL << (i % 64);
+		}
+	}
+	return nl;
+}
+
+/** Returns the constant size of the list. */
+#define sortednlist_size(l) ((l)->size)
+
+/** Returns the number of currently removed numbers, from 0 (empty) to size. */
+#define sortednlist_nremoved(l) ((l)->nremoved)
+
+/** Returns the last removed number in the stack, which must not be empty. */
+#define sortednlist_lastremoved(l) ((l)->stack[(l)->nremoved - 1])
+
+/** Returns the number removed in the given index of the stack, being 0 the
+ * index of the first removed number and nremoved - 1 the index of the last. */
+#define sortednlist_removed(l, i) ((l)->stack[i])
+
+/** Returns 0 if the given number is not in the stack of removed numbers. */
+#define sortednlist_isremoved(l, n) (! (((l)->bits[(l)->ranks[n] / 64] \
+		>> ((l)->ranks[n] % 64)) & 1))
+
+/* returns the first bit set from the given bit to the last, or 0 if none */
+static int sortednlist_nextbit(sortednlist nl, int b) {
+	int w = b / 64, nwords = SORTNLBITS_NWORDS(nl->size);
+	SORTNLBITS_WORD word;
+	if (w == nwords) {
+		return 0;
+	}
+	word = nl->bits[w] & (~0ULL << (b % 64));
+	while (! word) {
+		if (++w == nwords) {
+			return 0;
+		}
+		word = nl->bits[w];
+	}
+	return w * 64 + __builtin_ctzll(word);
+}
+
+/* returns the last bit set from the given bit to the first, or 0 if none */
+static int sortednlist_prevbit(sortednlist nl, int b) {
+	int w = b / 64;
+	SORTNLBITS_WORD word = nl->bits[w] & (~0ULL >> (63 - b % 64));
+	while (! word) {
+		if (w-- == 0) {
+			return 0;
+		}
+		word = nl->bits[w];
+	}
+	return w * 64 + 63 - __builtin_clzll(word);
+}
+
+/** Returns 0 when the given number does not have a next number. */
+SORTNL_TYPE sortednlist_next(sortednlist nl, SORTNL_TYPE n) {
+	return nl->nums[sortednlist_nextbit(nl, nl->ranks[n] + 1)];
+}
+
+/** Returns 0 when the given number does not have a previous number. */
+SORTNL_TYPE sortednlist_prev(sortednlist nl, SORTNL_TYPE n) {
+	return nl->nums[sortednlist_prevbit(nl,
+				n ? nl->ranks[n] - 1 : nl->size)];
+}
+
+/** Returns the first number currently not removed and the smallest one. */
+#define sortednlist_first(l) sortednlist_next(l, 0)
+
+/** Returns the last number currently not removed and the biggest one. */
+#define sortednlist_last(l) sortednlist_prev(l, 0)
+
+/** Saves in the given arrays the partial sums of the first and the last numbers
+ * currently not removed, being the index 0 the first/last number, the index 1
+ * the sum of the 2 first/last numbers, and so on, up to the given number of
+ * sums, returning the number of sums saved in each array. The numbers are taken
+ * clearing the lowest/highest bit of a copy of each word. */
+int sortednlist_getsums(sortednlist nl, int *minsums, int *maxsums, int nsums){
+	int k = 0, w, b, sum = 0, nwords = SORTNLBITS_NWORDS(nl->size);
+	SORTNLBITS_WORD word;
+	for (w = 0; k < nsums && w < nwords; w++) {
+		for (word = nl->bits[w]; k < nsums && word; word &= word - 1) {
+			sum += nl->nums[w * 64 + __builtin_ctzll(word)];
+			minsums[k++] = sum;
+		}
+	}
+	for (sum = k = 0, w = nwords - 1; k < nsums && w >= 0; w--) {
+		for (word = nl->bits[w]; k < nsums && word;
+					word &= ~(1ULL << b)) {
+			b = 63 - __builtin_clzll(word);
+			sum += nl->nums[w * 64 + b];
+			maxsums[k++] = sum;
+		}
+	}
+	return k;
+}
+
+/** Moves a given number to be after another given number changing the order of
+ * the list but without changing the direct access to the elements by number,
+ * by shifting the ranks of the numbers between them.
+ * Returns 0 if the stack of removed numbers is not empty. */
+int sortednlist_moveafter(sortednlist nl, SORTNL_TYPE n, SORTNL_TYPE p) {
+	int r, nrank, prank;
+	assert(n < nl->size + 1 && p < nl->size + 1);
+	if (nl->nremoved) {
+		return 0;
+	}
+	nrank = nl->ranks[n];
+	prank = nl->ranks[p];
+	if (n == p || nrank == prank + 1) {
+		return 1;
+	}
+	if (nrank > prank) {
+		for (r = nrank; r > prank + 1; r--) {
+			nl->nums[r] = nl->nums[r - 1];
+			nl->ranks[nl->nums[r]] = r;
+		}
+		r = prank + 1;
+	} else {
+		for (r = nrank; r < prank; r++) {
+			nl->nums[r] = nl->nums[r + 1];
+			nl->ranks[nl->nums[r]] = r;
+		}
+		r = prank;
+	}
+	nl->nums[r] = n;
+	nl->ranks[n] = r;
+	return 1;
+}
+
+/** Remove the given number from the list moving it to the stack of removed
+ * numbers returning 0 if that number is already removed. */
+SORTNL_TYPE sortednlist_remove(sortednlist nl, SORTNL_TYPE n) {
+	int r;
+	assert(n < nl->size + 1);
+	if (sortednlist_isremoved(nl, n)) {
+		return 0;
+	}
+	r = nl->ranks[n];
+	nl->bits[r / 64] &= ~(1ULL << (r % 64));
+	nl->stack[SORTNL_INDEX(nl->nremoved++)] = n;
+	return n;
+}
+
+/** Restore the most recent removed number and returns it or returns 0
+ * if the stack of removed numbers is currently empty.*/
+SORTNL_TYPE sortednlist_restore(sortednlist nl) {
+	if (nl->nremoved) {
+		int n = nl->stack[SORTNL_INDEX(--(nl->nremoved))];
+		int r = nl->ranks[n];
+		nl->bits[r / 64] |= 1ULL << (r % 64);
+		return n;
+	}
+	return 0;
+}
+
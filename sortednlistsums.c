@@ -1,50 +1,156 @@
 /**
- * sortednlistsums - Pack of two arrays to save the sums of the N first/last
- * numbers of a sortednlist. To create the arrays for N numbers, a char array
- * of size SORTEDNLISTSUMS_BYTES(N) must be initialized by calling to
- * sortednlistsums_init(array N) that returns the array of type sortednlistsums.
+ * sortednlistsums - Stack of pairs of arrays to save the sums of the N
+ * first/last numbers of a sortednlist, with one level for each number removed
+ * from the list, that is updated incrementally when a number is removed and
+ * restored by dropping the last level. To create the arrays for N numbers of a
+ * list of L numbers, a char array of size SORTEDNLISTSUMS_BYTES(N, L) must be
+ * initialized by calling to sortednlistsums_init(array, N, L) that returns the
+ * array of type sortednlistsums, and the first level must be saved for the
+ * numbers of the list by calling to sortednlistsums_get(sums, list). Each
+ * array is preceded by a 0, the sum of no numbers, so the sums of k numbers are
+ * read in the index k - 1 also for k = 0, without checking it.
  *
  * Copyright 2021 Carlos Rica (jasampler)
  * This file is part of the jasampler's magic-square project.
  */
+typedef struct sortednlistsums_level_st {
+	int len, minchg, maxchg, *minsums, *maxsums;
+} sortednlistsums_level;
+
 typedef struct sortednlistsums_st {
-	int size, len, *minsums, *maxsums;
+	int size, len, minchg, maxchg, *minsums, *maxsums, depth;
+	sortednlistsums_level *levels;
+	int *sums;
 } *sortednlistsums;
 
-#define SORTEDNLISTSUMS_BYTES(size) \
+#define SORTEDNLISTSUMS_BYTES(size, nlsize) \
 	(sizeof(struct sortednlistsums_st) \
-		+ ((size + size) * sizeof(int)))
+		+ (((nlsize) + 1) * sizeof(sortednlistsums_level)) \
+		+ (((nlsize) + 1) * ((size) + (size) + 2) * sizeof(int)))
+
+/* returns the array of minimum sums of the given level in the given sums, each
+ * level saving a 0 and the minimum sums followed by a 0 and the maximum sums */
+#define SORTNLSUMS_MINSUMS(sums, size, depth) \
+	((sums) + (depth) * ((size) + (size) + 2) + 1)
+#define SORTNLSUMS_MAXSUMS(sums, size, depth) \
+	(SORTNLSUMS_MINSUMS(sums, size, depth) + (size) + 1)
+
+/* returns the number added in the given index of an array of partial sums */
+#define SORTNLSUMS_NUM(sums, k) ((k) ? (sums)[k] - (sums)[(k) - 1] : (sums)[0])
 
-/** Must receive as arguments an array of SORTEDNLISTSUMS_BYTES(N) bytes and the
- * same number N, and returns the same array initalized as a sortednlistsums. */
-sortednlistsums sortednlistsums_init(char *mem, int size) {
+/** Must receive as arguments an array of SORTEDNLISTSUMS_BYTES(N, L) bytes and
+ * the same numbers N and L, and returns the same array initalized as a
+ * sortednlistsums. */
+sortednlistsums sortednlistsums_init(char *mem, int size, int nlsize) {
 	sortednlistsums sm = (sortednlistsums) mem;
-	int *minsums = (int *) (sm + 1);
-	int *maxsums = minsums + size;
+	sortednlistsums_level *levels = (sortednlistsums_level *) (sm + 1);
+	int *sums = (int *) (levels + nlsize + 1);
 	sm->size = size;
 	sm->len = 0;
-	sm->minsums = minsums;
-	sm->maxsums = maxsums;
+	sm->minchg = 0;
+	sm->maxchg = 0;
+	sm->minsums = SORTNLSUMS_MINSUMS(sums, size, 0);
+	sm->maxsums = SORTNLSUMS_MAXSUMS(sums, size, 0);
+	sm->minsums[-1] = 0;
+	sm->maxsums[-1] = 0;
+	sm->depth = 0;
+	sm->levels = levels;
+	sm->sums = sums;
 	return sm;
 }
 
+/* copies the arrays of the given level to be used directly */
+static void sortednlistsums_setlevel(sortednlistsums sm, int depth) {
+	sortednlistsums_level *level = sm->levels + depth;
+	sm->depth = depth;
+	sm->len = level->len;
+	sm->minchg = level->minchg;
+	sm->maxchg = level->maxchg;
+	sm->minsums = level->minsums;
+	sm->maxsums = level->maxsums;
+}
+
 /** Saves in the minimum array the partial sums of the first numbers and
  * saves in the maximum array the partial sums of the last numbers. The index 0
  * saves the first/last number, the index 1 the sum of the 2 first/last numbers,
  * the index 2 the sum of 3, and so on, saving in len the number of saved sums,
- * that can be less than the size when there are less numbers in the list. */
-void sortednlistsums_get(sortednlistsums sm, sortednlist nl) {
-	int l, min, max, minsum = 0, maxsum = 0;
-	min = sortednlist_first(nl);
-	max = sortednlist_last(nl);
-	for (l = 0; l < sm->size && min; l++) {
-		minsum += min;
-		maxsum += max;
-		sm->minsums[l] = minsum;
-		sm->maxsums[l] = maxsum;
-		min = sortednlist_next(nl, min);
-		max = sortednlist_prev(nl, max);
+ * that can be less than the size when there are less numbers in the list.
+ * The sums are saved as the first level, for the numbers currently in the list,
+ * and the indexes of the first sums changed are 0 since all of them are new.
+ * The given size must be the size of the sums, and it can be a constant to let
+ * the compiler unroll the loops for it. */
+void sortednlistsums_getsize(sortednlistsums sm, sortednlist nl, int size) {
+	sortednlistsums_level *level = sm->levels;
+	level->minsums = SORTNLSUMS_MINSUMS(sm->sums, size, 0);
+	level->maxsums = SORTNLSUMS_MAXSUMS(sm->sums, size, 0);
+	level->minsums[-1] = 0;
+	level->maxsums[-1] = 0;
+	level->len = sortednlist_getsums(nl, level->minsums, level->maxsums,
+								size);
+	level->minchg = 0;
+	level->maxchg = 0;
+	sortednlistsums_setlevel(sm, 0);
+}
+
+/** Saves the sums of the list as the first level, for the size of the sums. */
+#define sortednlistsums_get(sm, nl) sortednlistsums_getsize(sm, nl, (sm)->size)
+
+/** Saves a new level with the sums of the list after removing from it the given
+ * number, and the indexes of the first sums changed, being size if none, since
+ * they only change when the number is one of the first/last. Only the number
+ * following the first/last ones is read from the list, and the arrays that do
+ * not change are shared with the previous level. */
+void sortednlistsums_remove(sortednlistsums sm, sortednlist nl, int n) {
+	sortednlistsums_level *old = sm->levels + sm->depth, *new = old + 1;
+	int size = sm->size, len = old->len, k, last;
+	int *sums = SORTNLSUMS_MINSUMS(sm->sums, size, sm->depth + 1);
+	int navailable = sortednlist_size(nl) - sortednlist_nremoved(nl);
+	new->len = navailable < size ? navailable : size;
+	last = SORTNLSUMS_NUM(old->minsums, len - 1);
+	if (n > last) {
+		new->minsums = old->minsums;
+		new->minchg = size;
+	} else {
+		new->minsums = sums;
+		for (k = 0; SORTNLSUMS_NUM(old->minsums, k) < n; k++) {
+			sums[k] = old->minsums[k];
+		}
+		new->minchg = k;
+		for (; k < len - 1; k++) {
+			sums[k] = old->minsums[k + 1] - n;
+		}
+		if (k < new->len) {
+			sums[k] = (k ? sums[k - 1] : 0)
+				+ sortednlist_next(nl, last);
+		}
+	}
+	sums[-1] = 0;
+	sums = SORTNLSUMS_MAXSUMS(sm->sums, size, sm->depth + 1);
+	sums[-1] = 0;
+	last = SORTNLSUMS_NUM(old->maxsums, len - 1);
+	if (n < last) {
+		new->maxsums = old->maxsums;
+		new->maxchg = size;
+	} else {
+		new->maxsums = sums;
+		for (k = 0; SORTNLSUMS_NUM(old->maxsums, k) > n; k++) {
+			sums[k] = old->maxsums[k];
+		}
+		new->maxchg = k;
+		for (; k < len - 1; k++) {
+			sums[k] = old->maxsums[k + 1] - n;
+		}
+		if (k < new->len) {
+			sums[k] = (k ? sums[k - 1] : 0)
+				+ sortednlist_prev(nl, last);
+		}
 	}
-	sm->len = l;
+	sortednlistsums_setlevel(sm, sm->depth + 1);
 }
 
+/** Drops the last level of sums, when the last removed number is restored. */
+void sortednlistsums_restore(sortednlistsums sm) {
+	if (sm->depth) {
+		sortednlistsums_setlevel(sm, sm->depth - 1);
+	}
+}
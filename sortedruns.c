@@ -0,0 +1,179 @@
+/**
+ * sortedruns - Sorter of records of fixed length ordered by their bytes, that
+ * keeps in memory a maximum number of records and writes them sorted to a new
+ * temporary file (a run) when there is no space for more, returning at the end
+ * all the records in order by merging the runs. To create a sorter of records
+ * of L bytes keeping R records in memory, a char array of size
+ * SORTEDRUNS_BYTES(L, R) must be initialized by calling to
+ * sortedruns_init(array, L, R) that returns the array of type sortedruns,
+ * and it must be closed by calling to sortedruns_close(sorter) to remove the
+ * temporary files.
+ *
+ * Copyright 2021 Carlos Rica (jasampler)
+ * This file is part of the jasampler's magic-square project.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct sortedruns_st {
+	int reclen, nruns, nheads;
+	size_t len, size, next;
+	char *recs, *heads;
+	FILE **runs;
+} *sortedruns;
+
+#define SORTEDRUNS_BYTES(reclen, size) \
+	(sizeof(struct sortedruns_st) + (size_t) (reclen) * (size))
+
+/** Must receive as arguments an array of SORTEDRUNS_BYTES(L, R) bytes and the
+ * same numbers L and R, and returns the same array initialized as a sortedruns
+ * without records. */
+sortedruns sortedruns_init(char *mem, int reclen, size_t size) {
+	sortedruns sr = (sortedruns) mem;
+	sr->reclen = reclen;
+	sr->nruns = 0;
+	sr->nheads = 0;
+	sr->len = 0;
+	sr->size = size;
+	sr->next = 0;
+	sr->recs = (char *) (sr + 1);
+	sr->heads = NULL;
+	sr->runs = NULL;
+	return sr;
+}
+
+/** Returns the number of records in memory, from 0 to size. */
+#define sortedruns_len(sr) ((sr)->len)
+
+/** Returns 1 when there is no space in memory for more records. */
+#define sortedruns_full(sr) ((sr)->len == (sr)->size)
+
+/** Returns the record of the given index in memory. */
+#define sortedruns_get(sr, i) ((sr)->recs + (size_t) (i) * (sr)->reclen)
+
+/** Copies the given record to the end of the records in memory, that must not
+ * be full, returning its copy. */
+char *sortedruns_add(sortedruns sr, const char *rec) {
+	char *copy = sortedruns_get(sr, sr->len++);
+	memcpy(copy, rec, sr->reclen);
+	return copy;
+}
+
+/* length of the records compared by qsort, that does not receive it */
+static int sortedruns_cmplen;
+
+static int sortedruns_cmp(const void *rec1, const void *rec2) {
+	return memcmp(rec1, rec2, sortedruns_cmplen);
+}
+
+/* sorts the records in memory */
+static void sortedruns_sort(sortedruns sr) {
+	sortedruns_cmplen = sr->reclen;
+	qsort(sr->recs, sr->len, sr->reclen, sortedruns_cmp);
+}
+
+/** Writes the records in memory sorted to a new temporary file, leaving the
+ * memory empty, and returns 0 if they could not be written. */
+char sortedruns_spill(sortedruns sr) {
+	FILE *f, **runs = realloc(sr->runs, (sr->nruns + 1) * sizeof(FILE *));
+	if (runs == NULL) {
+		return 0;
+	}
+	sr->runs = runs;
+	f = tmpfile();
+	if (f == NULL) {
+		perror("Cannot create a temporary file");
+		return 0;
+	}
+	sr->runs[sr->nruns++] = f;
+	sortedruns_sort(sr);
+	if (fwrite(sr->recs, sr->reclen, sr->len, f) != sr->len
+			|| fflush(f) || fseek(f, 0, SEEK_SET)) {
+		perror("Cannot write a temporary file");
+		return 0;
+	}
+	sr->len = 0;
+	return 1;
+}
+
+/** Prepares the records added to be read in order with sortedruns_next, sorting
+ * them in memory when there are no runs or merging all the runs otherwise, and
+ * returns 0 if they could not be prepared. No more records can be added. */
+char sortedruns_merge(sortedruns sr) {
+	int r;
+	sr->next = 0;
+	if (sr->nruns == 0) {
+		sortedruns_sort(sr);
+		return 1;
+	}
+	if (sr->len && ! sortedruns_spill(sr)) {
+		return 0;
+	}
+	sr->heads = malloc((size_t) sr->nruns * sr->reclen);
+	if (sr->heads == NULL) {
+		return 0;
+	}
+	for (r = 0; r < sr->nruns; r++) {
+		if (fread(sr->heads + r * sr->reclen, sr->reclen, 1,
+				sr->runs[r]) != 1) {
+			return 0;
+		}
+	}
+	sr->nheads = sr->nruns;
+	return 1;
+}
+
+/** Copies to the given record the next record in order, returning 1 if it was
+ * read, 0 when there are no more records or -1 if a run could not be read. The
+ * runs are merged taking each time the smallest of the first records of the
+ * runs, that are few since each run has the records of the whole memory. */
+int sortedruns_next(sortedruns sr, char *rec) {
+	int r, minr, reclen = sr->reclen;
+	FILE *f;
+	if (sr->nruns == 0) {
+		if (sr->next == sr->len) {
+			return 0;
+		}
+		memcpy(rec, sortedruns_get(sr, sr->next++), reclen);
+		return 1;
+	}
+	if (sr->nheads == 0) {
+		return 0;
+	}
+	for (minr = 0, r = 1; r < sr->nheads; r++) {
+		if (memcmp(sr->heads + r * reclen, sr->heads + minr * reclen,
+				reclen) < 0) {
+			minr = r;
+		}
+	}
+	memcpy(rec, sr->heads + minr * reclen, reclen);
+	if (fread(sr->heads + minr * reclen, reclen, 1, sr->runs[minr]) != 1) {
+		if (ferror(sr->runs[minr])) {
+			perror("Cannot read a temporary file");
+			return -1;
+		}
+		sr->nheads--;
+		f = sr->runs[minr];
+		sr->runs[minr] = sr->runs[sr->nheads];
+		sr->runs[sr->nheads] = f;
+		memcpy(sr->heads + minr * reclen,
+			sr->heads + sr->nheads * reclen, reclen);
+	}
+	return 1;
+}
+
+/** Closes and removes the temporary files of the runs. */
+void sortedruns_close(sortedruns sr) {
+	int r;
+	for (r = 0; r < sr->nruns; r++) {
+		fclose(sr->runs[r]);
+	}
+	free(sr->runs);
+	free(sr->heads);
+	sr->runs = NULL;
+	sr->heads = NULL;
+	sr->nruns = 0;
+	sr->nheads = 0;
+	sr->len = 0;
+}
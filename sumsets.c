@@ -0,0 +1,133 @@
+/**
+ * sumsets - Table of all the sets of N different numbers from 1 to NxN that add
+ * up to the magic sum of the NxN magic squares, the only sets of numbers that
+ * can fill a line, saved as bitmasks with the bit n-1 for the number n and
+ * indexed by each pair of numbers that they contain, so the sets that contain
+ * some given numbers are found reading only the sets of one pair of them.
+ * Only sizes with at most 64 numbers are supported. To create the table for
+ * size N with K sets, being K the number returned by sumsets_count(N), a char
+ * array of size SUMSETS_BYTES(N, K) must be initialized by calling to
+ * sumsets_init(array, N, K) that returns the array of type sumsets.
+ *
+ * Copyright 2021 Carlos Rica (jasampler)
+ * This file is part of the jasampler's magic-square project.
+ */
+#define SUMSETS_MAXSIDE 7
+
+typedef struct sumsets_st {
+	int side, nsets, *pairstarts;
+	unsigned long long *sets;
+	unsigned int *pairsets;
+} *sumsets;
+
+/* returns the index of the pair of the numbers a < b from 1 to ncells */
+#define SUMSETS_PAIRIDX(a, b, ncells) (((a) - 1) * (ncells) + (b) - 1)
+
+#define SUMSETS_BYTES(side, nsets) \
+	(sizeof(struct sumsets_st) \
+		+ ((size_t) (nsets) * sizeof(unsigned long long)) \
+		+ ((size_t) (side) * (side) * (side) * (side) + 1) \
+			* sizeof(int) \
+		+ ((size_t) (nsets) * (side) * ((side) - 1) / 2 \
+			* sizeof(unsigned int)))
+
+/* adds to the given sets, when it is not NULL, the sets that complete the
+ * given set with k numbers from first to last adding up to sum, and returns
+ * the number of sets completed */
+static int sumsets_complete(unsigned long long *sets, unsigned long long set,
+				int k, int first, int last, int sum) {
+	int n, count = 0;
+	if (k == 0) {
+		if (sum == 0 && sets) {
+			sets[0] = set;
+		}
+		return sum == 0;
+	}
+	/* the k numbers up to last are at most k * last - k * (k - 1) / 2 */
+	if (k * last - k * (k - 1) / 2 < sum) {
+		return 0;
+	}
+	/* the k numbers from n are at least k * n + k * (k - 1) / 2 */
+	for (n = first; n <= last && k * n + k * (k - 1) / 2 <= sum; n++) {
+		count += sumsets_complete(sets ? sets + count : NULL,
+				set | (1ULL << (n - 1)), k - 1, n + 1, last,
+				sum - n);
+	}
+	return count;
+}
+
+/** Returns the number of sets of the table for the given side, or 0 if the side
+ * is not supported. */
+int sumsets_count(int side) {
+	if (side < 1 || side > SUMSETS_MAXSIDE) {
+		return 0;
+	}
+	return sumsets_complete(NULL, 0, side, 1, side * side,
+				(side * (side * side + 1)) / 2);
+}
+
+/** Must receive as arguments an array of SUMSETS_BYTES(N, K) bytes and the
+ * same numbers N and K, being K = sumsets_count(N), and returns the same array
+ * initialized as a sumsets with all the sets indexed by their pairs. */
+sumsets sumsets_init(char *mem, int side, int nsets) {
+	sumsets ss = (sumsets) mem;
+	int s, a, b, p, ncells = side * side, npairs = ncells * ncells;
+	unsigned long long set, rest;
+	ss->side = side;
+	ss->nsets = nsets;
+	ss->sets = (unsigned long long *) (ss + 1);
+	ss->pairstarts = (int *) (ss->sets + nsets);
+	ss->pairsets = (unsigned int *) (ss->pairstarts + npairs + 1);
+	sumsets_complete(ss->sets, 0, side, 1, ncells,
+				(side * (ncells + 1)) / 2);
+	for (p = 0; p <= npairs; p++) {
+		ss->pairstarts[p] = 0;
+	}
+	/* counts the sets of each pair, saving in each start its end */
+	for (s = 0; s < nsets; s++) {
+		for (set = ss->sets[s]; set; set &= set - 1) {
+			a = __builtin_ctzll(set) + 1;
+			for (rest = set & (set - 1); rest; rest &= rest - 1) {
+				b = __builtin_ctzll(rest) + 1;
+				p = SUMSETS_PAIRIDX(a, b, ncells);
+				ss->pairstarts[p + 1]++;
+			}
+		}
+	}
+	for (p = 0; p < npairs; p++) {
+		ss->pairstarts[p + 1] += ss->pairstarts[p];
+	}
+	for (s = 0; s < nsets; s++) {
+		for (set = ss->sets[s]; set; set &= set - 1) {
+			a = __builtin_ctzll(set) + 1;
+			for (rest = set & (set - 1); rest; rest &= rest - 1) {
+				b = __builtin_ctzll(rest) + 1;
+				p = SUMSETS_PAIRIDX(a, b, ncells);
+				ss->pairsets[ss->pairstarts[p]++] = s;
+			}
+		}
+	}
+	/* the starts were moved to the ends of their pairs */
+	for (p = npairs; p > 0; p--) {
+		ss->pairstarts[p] = ss->pairstarts[p - 1];
+	}
+	ss->pairstarts[0] = 0;
+	return ss;
+}
+
+/** Returns 1 if there is any set of the table that contains all the numbers of
+ * the given mask of a line with at least two numbers, being a < b two of them,
+ * and whose other numbers are all in the given mask of available numbers. */
+char sumsets_canfill(sumsets ss, int a, int b, unsigned long long line,
+			unsigned long long available) {
+	int p = SUMSETS_PAIRIDX(a, b, ss->side * ss->side);
+	int k, end = ss->pairstarts[p + 1];
+	unsigned long long set, allowed = line | available;
+	for (k = ss->pairstarts[p]; k < end; k++) {
+		set = ss->sets[ss->pairsets[k]];
+		if ((set & line) == line && (set & ~allowed) == 0) {
+			return 1;
+		}
+	}
+	return 0;
+}
@@ -1,9 +1,11 @@
 /**
  * sumsquare - Table with NxN cells that allows storing positive integers on it
- * and maintains the sum of each "line", currently rows, columns and diagonals,
- * maintaining also the number of empty holes in each line. To create a
- * table of NxN, a char array of size SUMSQUARE_BYTES(N) must be initialized by
- * calling to sumsquare_init(array, N) that returns the array of type sumsquare.
+ * and maintains the sum of each "line", the rows and columns and the kinds of
+ * lines chosen, maintaining also the number of empty holes in each line, saved
+ * in two arrays of integers to read the same field of all the lines together,
+ * and the sum that each line has in a magic square. To create a table of NxN,
+ * a char array of size SUMSQUARE_BYTES(N) must be initialized by calling to
+ * sumsquare_init(array, N, lines) that returns the array of type sumsquare.
  *
  * Copyright 2021 Carlos Rica (jasampler)
  * This file is part of the jasampler's magic-square project.
@@ -14,7 +16,28 @@
 #define SUMSQ_SUMTYPE int
 #define SUMSQ_SIDEX(side) (((SUMSQ_SUMTYPE) side) * side)
 #define SUMSQ_SIDE2(side) (((int) side) + side)
-#define SUMSQ_MAXCELLLINES 4
+#define SUMSQ_MAXCELLLINES 5
+
+/** Kinds of lines added to the rows and columns, that can be combined: the two
+ * main diagonals, the broken diagonals parallel to them (that also add the
+ * main ones) and the pairs of cells symmetric about the center, whose sum is
+ * N*N + 1 in the associative squares. The magic squares have the diagonals. */
+#define SUMSQ_DIAGONALS 1
+#define SUMSQ_BROKEN 2
+#define SUMSQ_PAIRS 4
+#define SUMSQ_MAGICLINES SUMSQ_DIAGONALS
+
+/* lines of each kind, before the lines of the next kind in that order */
+#define SUMSQ_NDIAGONALS(side, lines) \
+	((lines) & (SUMSQ_DIAGONALS | SUMSQ_BROKEN) ? 2 : 0)
+#define SUMSQ_NBROKEN(side, lines) \
+	((lines) & SUMSQ_BROKEN ? SUMSQ_SIDE2(side) - 2 : 0)
+#define SUMSQ_NPAIRS(side, lines) \
+	((lines) & SUMSQ_PAIRS ? SUMSQ_SIDEX(side) / 2 : 0)
+#define SUMSQ_NLINES(side, lines) (SUMSQ_SIDE2(side) \
+	+ SUMSQ_NDIAGONALS(side, lines) + SUMSQ_NBROKEN(side, lines) \
+	+ SUMSQ_NPAIRS(side, lines))
+#define SUMSQ_MAXLINES(side) SUMSQ_NLINES(side, SUMSQ_BROKEN | SUMSQ_PAIRS)
 
 typedef struct sumsquare_cellrelation_st {
 	SUMSQ_NUMTYPE ncelllines, celllines[SUMSQ_MAXCELLLINES];
@@ -30,10 +53,10 @@ typedef struct sumsquare_linecount_st {
 } sumsquare_linecount;
 
 typedef struct sumsquare_st {
-	SUMSQ_NUMTYPE side, nlines, ncells, *nums;
+	SUMSQ_NUMTYPE side, nlines, ncells, lines, *nums;
 	sumsquare_cellrelation *cellrelations;
 	sumsquare_linerelation *linerelations;
-	sumsquare_linecount *linecounts;
+	SUMSQ_SUMTYPE *linesums, *lineholes, *linemsums;
 } *sumsquare;
 
 #define SUMSQ_IFROMPOS(cellidx, side) ((cellidx) / (side))
@@ -43,20 +66,35 @@ typedef struct sumsquare_st {
 #define SUMSQUARE_COLIDX(sq, j) (((sq)->side) + (j))
 #define SUMSQUARE_DIAGIDX(sq, d) (SUMSQ_SIDE2((sq)->side) + (d))
 
-/** Returns a cellrelation struct with the lines that contain the given cell. */
+/** Returns a cellrelation struct with the lines of the given kinds that contain
+ * the given cell. The broken diagonals are numbered by the difference of the
+ * column and the row (the sum plus one for the other direction) modulo N, the
+ * main diagonals being the 0, and the pairs by their first cell. */
 sumsquare_cellrelation sumsquare_cellrelation_init(int cellidx,
-		SUMSQ_NUMTYPE side){
+		SUMSQ_NUMTYPE side, SUMSQ_NUMTYPE lines){
 	sumsquare_cellrelation cell;
 	int i = SUMSQ_IFROMPOS(cellidx, side);
 	int j = SUMSQ_JFROMPOS(cellidx, side);
-	int count = 0;
+	int d = (side + j - i) % side, a = (i + j + 1) % side;
+	int ncells = SUMSQ_SIDEX(side), l = SUMSQ_SIDE2(side) + 2, count = 0;
 	cell.celllines[count++] = i;
 	cell.celllines[count++] = side + j;
-	if (i == j) {
-		cell.celllines[count++] = SUMSQ_SIDE2(side);
+	if (lines & SUMSQ_BROKEN) {
+		cell.celllines[count++] = d ? l + d - 1 : SUMSQ_SIDE2(side);
+		cell.celllines[count++] = a ? l + side + a - 2
+					: SUMSQ_SIDE2(side) + 1;
+	} else if (lines & SUMSQ_DIAGONALS) {
+		if (i == j) {
+			cell.celllines[count++] = SUMSQ_SIDE2(side);
+		}
+		if (i + j == side - 1) {
+			cell.celllines[count++] = SUMSQ_SIDE2(side) + 1;
+		}
 	}
-	if (i + j == side - 1) {
-		cell.celllines[count++] = SUMSQ_SIDE2(side) + 1;
+	l = SUMSQ_NLINES(side, lines & ~SUMSQ_PAIRS);
+	if (lines & SUMSQ_PAIRS && cellidx != ncells - 1 - cellidx) {
+		cell.celllines[count++] = l + (cellidx < ncells - 1 - cellidx
+					? cellidx : ncells - 1 - cellidx);
 	}
 	cell.ncelllines = count;
 	return cell;
@@ -87,44 +125,51 @@ sumsquare_linerelation sumsquare_linerelation_init(int lineidx,
 
 #define SUMSQUARE_BYTES(side) \
 	(sizeof(struct sumsquare_st) \
+		+ (3 * SUMSQ_MAXLINES(side) * sizeof(SUMSQ_SUMTYPE)) \
+		+ (SUMSQ_MAXLINES(side) * sizeof(sumsquare_linerelation)) \
 		+ (SUMSQ_SIDEX(side) * sizeof(SUMSQ_NUMTYPE)) \
 		+ (SUMSQ_SIDEX(side) * sizeof(sumsquare_cellrelation)) \
-		+ ((SUMSQ_SIDE2(side) + 2) * sizeof(sumsquare_linerelation)) \
-		+ ((SUMSQ_SIDE2(side) + 2) * sizeof(sumsquare_linecount)) \
-		+ ((SUMSQ_SIDE2(side) + 2) * (side) * sizeof(SUMSQ_NUMTYPE)))
+		+ (SUMSQ_MAXLINES(side) * (side) * sizeof(SUMSQ_NUMTYPE)))
 
-/** Must receive as arguments an array of SUMSQUARE_BYTES(N) bytes and the
- * same number N, and returns the same array initalized as a sumsquare. */
-sumsquare sumsquare_init(char *mem, SUMSQ_NUMTYPE side) {
+/** Must receive as arguments an array of SUMSQUARE_BYTES(N) bytes, the same
+ * number N and the kinds of lines added to the rows and columns, and returns
+ * the same array initalized as a sumsquare. */
+sumsquare sumsquare_init(char *mem, SUMSQ_NUMTYPE side, SUMSQ_NUMTYPE lines) {
 	int c, l;
 	SUMSQ_NUMTYPE ncells = SUMSQ_SIDEX(side);
-	SUMSQ_NUMTYPE nlines = SUMSQ_SIDE2(side) + 2;
+	SUMSQ_NUMTYPE nlines = SUMSQ_NLINES(side, lines);
+	SUMSQ_SUMTYPE msum = side * (ncells + 1) / 2;
 	sumsquare sq = (sumsquare) mem;
-	SUMSQ_NUMTYPE *nums = (SUMSQ_NUMTYPE *) (sq + 1);
+	SUMSQ_SUMTYPE *linesums = (SUMSQ_SUMTYPE *) (sq + 1);
+	SUMSQ_SUMTYPE *lineholes = linesums + nlines;
+	SUMSQ_SUMTYPE *linemsums = lineholes + nlines;
+	sumsquare_linerelation *linerelations = (sumsquare_linerelation *)
+					(linemsums + nlines);
+	SUMSQ_NUMTYPE *nums = (SUMSQ_NUMTYPE *) (linerelations + nlines);
 	sumsquare_cellrelation *cellrelations = (sumsquare_cellrelation *)
 					(nums + ncells);
-	sumsquare_linerelation *linerelations = (sumsquare_linerelation *)
-					(cellrelations + ncells);
-	sumsquare_linecount *linecounts = (sumsquare_linecount *)
-					(linerelations + nlines);
 	SUMSQ_NUMTYPE *mainlinecells = (SUMSQ_NUMTYPE *)
-					(linecounts + nlines);
+					(cellrelations + ncells);
 	sq->side = side;
 	sq->ncells = ncells;
+	sq->lines = lines;
 	sq->nums = nums;
 	sq->cellrelations = cellrelations;
 	for (c = 0; c < ncells; c++) {
 		nums[c] = 0;
-		cellrelations[c] = sumsquare_cellrelation_init(c, side);
+		cellrelations[c] = sumsquare_cellrelation_init(c, side, lines);
 	}
 	sq->nlines = nlines;
 	sq->linerelations = linerelations;
-	sq->linecounts = linecounts;
+	sq->linesums = linesums;
+	sq->lineholes = lineholes;
+	sq->linemsums = linemsums;
 	for (l = 0; l < nlines; l++) {
 		linerelations[l] = sumsquare_linerelation_init(l, side,
 					ncells, cellrelations, mainlinecells);
-		linecounts[l].sum = 0;
-		linecounts[l].holes = sq->side;
+		linesums[l] = 0;
+		lineholes[l] = linerelations[l].nlinecells;
+		linemsums[l] = msum * linerelations[l].nlinecells / side;
 	}
 	return sq;
 }
@@ -132,10 +177,21 @@ sumsquare sumsquare_init(char *mem, SUMSQ_NUMTYPE side) {
 #define sumsquare_side(sq) ((sq)->side)
 #define sumsquare_nlines(sq) ((sq)->nlines)
 #define sumsquare_ncells(sq) ((sq)->ncells)
+#define sumsquare_lines(sq) ((sq)->lines)
 #define sumsquare_getnum(sq, c) ((sq)->nums[c])
 #define sumsquare_getcellrelation(sq, c) ((sq)->cellrelations[c])
 #define sumsquare_getlinerelation(sq, l) ((sq)->linerelations[l])
-#define sumsquare_getlinecount(sq, l) ((sq)->linecounts[l])
+#define sumsquare_linesum(sq, l) ((sq)->linesums[l])
+#define sumsquare_lineholes(sq, l) ((sq)->lineholes[l])
+#define sumsquare_linemsum(sq, l) ((sq)->linemsums[l])
+
+/** Returns a linecount struct with the sum and the holes of the given line. */
+static inline sumsquare_linecount sumsquare_getlinecount(sumsquare sq, int l) {
+	sumsquare_linecount line;
+	line.sum = sumsquare_linesum(sq, l);
+	line.holes = sumsquare_lineholes(sq, l);
+	return line;
+}
 
 void sumsquare_setnum(sumsquare sq, int cellidx, SUMSQ_NUMTYPE n) {
 	SUMSQ_NUMTYPE old = sumsquare_getnum(sq, cellidx);
@@ -146,8 +202,7 @@ void sumsquare_setnum(sumsquare sq, int cellidx, SUMSQ_NUMTYPE n) {
 	if (sumdif) {
 		cell = sumsquare_getcellrelation(sq, cellidx);
 		for (l = 0; l < cell.ncelllines; l++) {
-			sumsquare_getlinecount(sq, cell.celllines[l]).sum
-				+= sumdif;
+			sumsquare_linesum(sq, cell.celllines[l]) += sumdif;
 		}
 		sumsquare_getnum(sq, cellidx) += sumdif;
 	}
@@ -156,12 +211,39 @@ void sumsquare_setnum(sumsquare sq, int cellidx, SUMSQ_NUMTYPE n) {
 			cell = sumsquare_getcellrelation(sq, cellidx);
 		}
 		for (l = 0; l < cell.ncelllines; l++) {
-			sumsquare_getlinecount(sq, cell.celllines[l]).holes
+			sumsquare_lineholes(sq, cell.celllines[l])
 				+= holesdif;
 		}
 	}
 }
 
+/** Same as sumsquare_setnum but finding the lines of the cell from the given
+ * side, that must be the side of the square, instead of reading the relations
+ * of the cell, so the compiler can avoid the divisions when it is a constant.
+ * The square must have the lines of the magic squares, SUMSQ_MAGICLINES. */
+void sumsquare_setnumside(sumsquare sq, int cellidx, SUMSQ_NUMTYPE n,
+		int side) {
+	SUMSQ_NUMTYPE old = sumsquare_getnum(sq, cellidx);
+	int sumdif = n - ((int) old);
+	int holesdif = (! old && n) ? -1 : (old && ! n) ? +1 : 0;
+	int i = SUMSQ_IFROMPOS(cellidx, side);
+	int j = SUMSQ_JFROMPOS(cellidx, side);
+	SUMSQ_SUMTYPE *linesums = sq->linesums, *lineholes = sq->lineholes;
+	linesums[i] += sumdif;
+	lineholes[i] += holesdif;
+	linesums[side + j] += sumdif;
+	lineholes[side + j] += holesdif;
+	if (i == j) {
+		linesums[SUMSQ_SIDE2(side)] += sumdif;
+		lineholes[SUMSQ_SIDE2(side)] += holesdif;
+	}
+	if (i + j == side - 1) {
+		linesums[SUMSQ_SIDE2(side) + 1] += sumdif;
+		lineholes[SUMSQ_SIDE2(side) + 1] += holesdif;
+	}
+	sumsquare_getnum(sq, cellidx) = n;
+}
+
 /** Returns the first empty cell of the given line. */
 int sumsquare_emptycell(sumsquare sq, int lineidx) {
 	sumsquare_linerelation line = sumsquare_getlinerelation(sq, lineidx);
@@ -175,3 +257,45 @@ int sumsquare_emptycell(sumsquare sq, int lineidx) {
 	return 0;
 }
 
+/** Returns 1 if the square has each number from 1 to NxN once and all its lines
+ * have no holes and their sum in a magic square, or 0 otherwise. */
+char sumsquare_ismagic(sumsquare sq) {
+	char seen[256]; /* one for each value of SUMSQ_NUMTYPE */
+	int c, l, n, ncells = sumsquare_ncells(sq);
+	for (n = 0; n <= ncells; n++) {
+		seen[n] = 0;
+	}
+	for (c = 0; c < ncells; c++) {
+		n = sumsquare_getnum(sq, c);
+		if (n < 1 || n > ncells || seen[n]) {
+			return 0;
+		}
+		seen[n] = 1;
+	}
+	for (l = 0; l < sumsquare_nlines(sq); l++) {
+		if (sumsquare_getlinecount(sq, l).sum
+					!= sumsquare_linemsum(sq, l)
+				|| sumsquare_getlinecount(sq, l).holes) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/** Copies to the first square the numbers of the second one moved by the given
+ * table, that has for each cell the cell of the second square whose number is
+ * copied, and copies the sums of the lines of the second square, that are the
+ * same in both squares when the table is a symmetry of the magic squares. */
+void sumsquare_permute(sumsquare dst, sumsquare src,
+			const SUMSQ_NUMTYPE *table) {
+	int c, l, ncells = sumsquare_ncells(src);
+	int nlines = sumsquare_nlines(src);
+	for (c = 0; c < ncells; c++) {
+		sumsquare_getnum(dst, c) = sumsquare_getnum(src, table[c]);
+	}
+	for (l = 0; l < nlines; l++) {
+		sumsquare_linesum(dst, l) = sumsquare_linesum(src, l);
+		sumsquare_lineholes(dst, l) = sumsquare_lineholes(src, l);
+	}
+}
+
@@ -1,75 +1,18 @@
 /**
- * sumsquareio - Functions for printing magic squares of type sumsquare.
+ * sumsquareio - Functions for reading magic squares of type sumsquare from the
+ * text written by sumsquarewriter and for printing the sums of their lines.
  *
  * Copyright 2021 Carlos Rica (jasampler)
  * This file is part of the jasampler's magic-square project.
  */
 #include <stdio.h>
+#include <string.h>
 
 static char DIGITS[] =
 	"0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ_abcdefghijklmnopqrstuvwxyz{}";
 #define MAX_DIGITS (sizeof(DIGITS))
 #define FIXEDWIDTH_BASE MAX_DIGITS
 
-void sumsquare_print(sumsquare sq) {
-	int i, j, side = sumsquare_side(sq);
-	char *fmt;
-	if (side * side < 10) {
-		fmt = " %d";
-	} else if (side * side < 100) {
-		fmt = " %2d";
-	} else {
-		fmt = " %3d";
-	}
-	for (i = 0; i < side; i++) {
-		for (j = 0; j < side; j++) {
-			printf(fmt + (j ? 0 : 1),
-				sumsquare_getnum(sq, i * side + j));
-		}
-		printf("\n");
-	}
-	printf("\n");
-}
-
-void sumsquare_printline(sumsquare sq) {
-	int p, n, sidexside = sumsquare_side(sq);
-	sidexside *= sidexside;
-	for (p = 0; p < sidexside; p++) {
-		if (p) {
-			printf(",");
-		}
-		n = sumsquare_getnum(sq, p);
-		if (n) {
-			printf("%d", n);
-		}
-	}
-	printf("\n");
-}
-
-/* Prints a number with fixed width, adding zeros at the beginning if needed. */
-void sumsquare_printfixedwidth(int n, unsigned char base,
-				unsigned char fixedwidth) {
-	unsigned char nwidth;
-	int pow, m;
-	if (n > base - 1) {
-		for (m = n / base, nwidth = 1, pow = 1; m;
-				nwidth++, pow *= base, m /= base) { }
-		for (; fixedwidth > nwidth; fixedwidth--) {
-			putchar(DIGITS[0]);
-		}
-		do {
-			putchar(DIGITS[n / pow]);
-			n %= pow;
-			pow /= base;
-		} while (pow > 1);
-	} else {
-		for (; fixedwidth > 1; fixedwidth--) {
-			putchar(DIGITS[0]);
-		}
-	}
-	putchar(DIGITS[n]);
-}
-
 /** Returns the width in the given base of the biggest number of the square. */
 unsigned char sumsquare_fixedwidth(sumsquare sq, unsigned char base) {
 	unsigned char nwidth;
@@ -79,26 +22,6 @@ unsigned char sumsquare_fixedwidth(sumsquare sq, unsigned char base) {
 	return nwidth;
 }
 
-/** Prints the numbers of the square with fixed width and without separation.
- * The short format removes the last column, last row and the 2nd number in the
- * row previous to the last, since these can be calculated in magic squares. */
-void sumsquare_printreduced(sumsquare sq, char shortformat, unsigned char base,
-						unsigned char fixedwidth) {
-	int i, j, side = sumsquare_side(sq);
-	int maxline = shortformat ? side - 1 : side;
-	int skipi = shortformat ? side - 2 : -1;
-	int skipj = shortformat ? 1 : -1;
-	for (i = 0; i < maxline; i++) {
-		for (j = 0; j < maxline; j++) {
-			if (i != skipi || j != skipj) {
-				sumsquare_printfixedwidth(sumsquare_getnum(sq,
-					i * side + j), base, fixedwidth);
-			}
-		}
-	}
-	putchar('\n');
-}
-
 #define ROWIDX(sq, i) SUMSQUARE_ROWIDX(sq, i)
 #define COLIDX(sq, j) SUMSQUARE_COLIDX(sq, j)
 #define DIAGIDX(sq, d) SUMSQUARE_DIAGIDX(sq, d)
@@ -133,3 +56,304 @@ void sumsquare_printsums(sumsquare sq) {
 	printf("(%d)\n\n", sumsquare_getlinecount(sq, DIAGIDX(sq, 0)).holes);
 }
 
+
+/** Returns the value of the given digit of the reduced formats, or -1,
+ * calculated from the ranges of characters of DIGITS. */
+int sumsquare_digitvalue(char c) {
+	if (c >= '0' && c <= '9') {
+		return c - '0';
+	} else if (c >= 'A' && c <= 'Z') {
+		return c - 'A' + 10;
+	} else if (c == '_') {
+		return 36;
+	} else if (c >= 'a' && c <= '}' && c != '|') {
+		return c - 'a' + 37 - (c > '|');
+	}
+	return -1;
+}
+
+/** Writes in the given empty cell the number needed by the given line to have
+ * the magic sum, returning 0 if that number is not valid for the square. */
+char sumsquare_filllast(sumsquare sq, int cellidx, int lineidx, int msum) {
+	int n = msum - sumsquare_getlinecount(sq, lineidx).sum;
+	if (n < 1 || n > sumsquare_ncells(sq)) {
+		return 0;
+	}
+	sumsquare_setnum(sq, cellidx, n);
+	return 1;
+}
+
+/** Fills the numbers removed by the short format of a magic square, the last
+ * column, the last row and the 2nd number in the row previous to the last,
+ * using lines that have only one of these numbers. Returns 0 if not valid. */
+char sumsquare_fillshort(sumsquare sq, int msum) {
+	int i, j, side = sumsquare_side(sq), last = side - 1;
+	char r = 1;
+	for (i = 0; i < last - 1; i++) {
+		r = r && sumsquare_filllast(sq, i * side + last,
+					ROWIDX(sq, i), msum);
+	}
+	for (j = 0; j < last; j++) {
+		if (j != 1) {
+			r = r && sumsquare_filllast(sq, last * side + j,
+						COLIDX(sq, j), msum);
+		}
+	}
+	return r && sumsquare_filllast(sq, (last - 1) * side + 1,
+					DIAGIDX(sq, 1), msum)
+		&& sumsquare_filllast(sq, last * side + 1, COLIDX(sq, 1), msum)
+		&& sumsquare_filllast(sq, (last - 1) * side + last,
+					ROWIDX(sq, last - 1), msum)
+		&& sumsquare_filllast(sq, last * side + last,
+					DIAGIDX(sq, 0), msum);
+}
+
+/** Reads the numbers of one square printed with fixed width and without
+ * separation, returning 0 if the text does not have the expected numbers. */
+char sumsquare_readreduced(sumsquare sq, const char *text, char shortformat,
+				unsigned char base, unsigned char fixedwidth) {
+	int i, j, w, d, n, side = sumsquare_side(sq);
+	int maxline = shortformat ? side - 1 : side;
+	int skipi = shortformat ? side - 2 : -1;
+	int skipj = shortformat ? 1 : -1;
+	for (i = 0; i < maxline; i++) {
+		for (j = 0; j < maxline; j++) {
+			if (i != skipi || j != skipj) {
+				for (n = 0, w = 0; w < fixedwidth; w++) {
+					d = sumsquare_digitvalue(*text++);
+					if (d < 0 || d >= base) {
+						return 0;
+					}
+					n = n * base + d;
+				}
+				if (n < 1 || n > sumsquare_ncells(sq)) {
+					return 0;
+				}
+				sumsquare_setnum(sq, i * side + j, n);
+			}
+		}
+	}
+	return *text == '\0' || *text == '\n';
+}
+
+/** Reads the decimal numbers of one square separated by the given separator,
+ * returning 0 if the text does not have the expected numbers. */
+char sumsquare_readdecimal(sumsquare sq, const char *text, char separator) {
+	int c, n, ncells = sumsquare_ncells(sq);
+	for (c = 0; c < ncells; c++) {
+		while (separator == ' ' && *text == ' ') {
+			text++;
+		}
+		if (c && separator != ' ' && *text++ != separator) {
+			return 0;
+		}
+		if (*text < '0' || *text > '9') {
+			return 0;
+		}
+		for (n = 0; *text >= '0' && *text <= '9'; text++) {
+			n = n * 10 + (*text - '0');
+		}
+		if (n < 1 || n > ncells) {
+			return 0;
+		}
+		sumsquare_setnum(sq, c, n);
+	}
+	while (separator == ' ' && *text == ' ') {
+		text++;
+	}
+	return *text == '\0' || *text == '\n';
+}
+
+/** Reads the decimal numbers of one partial square separated by commas, with
+ * the holes empty or 0, as written by the one line style for the incomplete
+ * squares, returning 0 if the text does not have the expected numbers. */
+char sumsquare_readpartial(sumsquare sq, const char *text) {
+	int c, n, ncells = sumsquare_ncells(sq);
+	for (c = 0; c < ncells; c++) {
+		if (c && *text++ != ',') {
+			return 0;
+		}
+		for (n = 0; *text >= '0' && *text <= '9' && n <= ncells;
+				text++) {
+			n = n * 10 + (*text - '0');
+		}
+		if (n > ncells) {
+			return 0;
+		}
+		sumsquare_setnum(sq, c, n);
+	}
+	return *text == '\0' || *text == '\n';
+}
+
+/* header of the binary styles, followed by a byte with the side, one with the
+ * filter level, one with 1 for the short format or 0 for the long one and one
+ * with the bits of each number */
+#define SUMSQ_BINARY_MAGIC "MSQB"
+#define SUMSQ_BINARY_HEADERLEN 8
+
+/** Returns the bits of each number in the binary styles, that save the numbers
+ * minus one to fit the 16 numbers of the 4x4 squares in 4 bits. */
+int sumsquare_binarybits(int side) {
+	int nbits, m;
+	for (m = side * side - 1, nbits = 1; m >>= 1; nbits++) { }
+	return nbits;
+}
+
+/** Returns the bytes of one square in the binary styles, with the numbers of
+ * the short or the long reduced format packed in bits and the last byte
+ * padded. */
+int sumsquare_binarylen(int side, char shortformat) {
+	int nnums = shortformat ? (side - 1) * (side - 1) - 1 : side * side;
+	return (nnums * sumsquare_binarybits(side) + 7) / 8;
+}
+
+/** Parses the header of a file of squares written in a binary style, saving its
+ * side, filter level and format, and returns 0 if it is not a valid header. */
+char sumsquare_parseheader(const unsigned char *header, int *side,
+				int *filterlevel, char *shortformat) {
+	if (memcmp(header, SUMSQ_BINARY_MAGIC, 4) || header[4] < 3
+			|| header[6] > 1
+			|| header[7] != sumsquare_binarybits(header[4])) {
+		return 0;
+	}
+	*side = header[4];
+	*filterlevel = header[5];
+	*shortformat = header[6];
+	return 1;
+}
+
+/** Reads the header of a file of squares written in a binary style, like
+ * sumsquare_parseheader, returning 0 if it is not a valid header. */
+char sumsquare_readheader(FILE *f, int *side, int *filterlevel,
+				char *shortformat) {
+	unsigned char header[SUMSQ_BINARY_HEADERLEN];
+	return fread(header, 1, SUMSQ_BINARY_HEADERLEN, f)
+			== SUMSQ_BINARY_HEADERLEN
+		&& sumsquare_parseheader(header, side, filterlevel,
+					shortformat);
+}
+
+/** Reads the numbers of one square packed in bits by a binary style, from the
+ * most significant bit of each byte, returning 0 if any number is not valid. */
+char sumsquare_readbinary(sumsquare sq, const unsigned char *data,
+				char shortformat) {
+	int i, j, n, side = sumsquare_side(sq);
+	int nbits = sumsquare_binarybits(side), nacc = 0;
+	int maxline = shortformat ? side - 1 : side;
+	int skipi = shortformat ? side - 2 : -1;
+	int skipj = shortformat ? 1 : -1;
+	unsigned int acc = 0;
+	for (i = 0; i < maxline; i++) {
+		for (j = 0; j < maxline; j++) {
+			if (i != skipi || j != skipj) {
+				if (nacc < nbits) {
+					acc = (acc << 8) | *data++;
+					nacc += 8;
+				}
+				nacc -= nbits;
+				n = ((acc >> nacc) & ((1 << nbits) - 1)) + 1;
+				if (n > sumsquare_ncells(sq)) {
+					return 0;
+				}
+				sumsquare_setnum(sq, i * side + j, n);
+			}
+		}
+	}
+	return 1;
+}
+
+#define SUMSQ_MAXLINELEN 4096
+
+/** Parses from the given text one square printed with the given print style,
+ * returning 1 if it was parsed, 0 at the end of the text or -1 if the text is
+ * not valid, and moving the text to the next square, after the next line or
+ * after the next empty line for the table style. The lines of the squares must
+ * end with a newline. The numbers removed by the short format are calculated
+ * from the magic sum, and the sums of the lines of the square are updated. */
+int sumsquare_parse(sumsquare sq, const char **ptext, const char *end,
+		char printstyle, unsigned char base, unsigned char fixedwidth) {
+	char rows[SUMSQ_MAXLINELEN], *r = rows;
+	const char *text = *ptext, *eol;
+	int c, i, len, side = sumsquare_side(sq), ncells = sumsquare_ncells(sq);
+	int msum = (side * (ncells + 1)) / 2;
+	if (text >= end) {
+		return 0;
+	}
+	for (c = 0; c < ncells; c++) {
+		sumsquare_setnum(sq, c, 0);
+	}
+	if (printstyle == 5 || printstyle == 6) {
+		len = sumsquare_binarylen(side, printstyle == 5);
+		if (end - text < len) {
+			*ptext = end;
+			return -1;
+		}
+		*ptext = text + len;
+		return sumsquare_readbinary(sq, (const unsigned char *) text,
+						printstyle == 5)
+			&& (printstyle == 6 || sumsquare_fillshort(sq, msum))
+			? 1 : -1;
+	}
+	if (printstyle == 4) {
+		for (i = 0; text < end && *text != '\n'; i++) {
+			eol = memchr(text, '\n', end - text);
+			len = (eol ? eol : end) - text;
+			if (len < SUMSQ_MAXLINELEN - (r - rows) - 1) {
+				memcpy(r, text, len);
+				r += len;
+				*r++ = ' ';
+			} else {
+				i = side + 1;
+			}
+			text = eol ? eol + 1 : end;
+		}
+		*r = '\0';
+		*ptext = text < end ? text + 1 : end;
+		return i == side && text < end
+			&& sumsquare_readdecimal(sq, rows, ' ') ? 1 : -1;
+	}
+	eol = memchr(text, '\n', end - text);
+	*ptext = eol ? eol + 1 : end;
+	if (eol == NULL) {
+		return -1;
+	}
+	if (printstyle == 1) {
+		return sumsquare_readreduced(sq, text, 1, base, fixedwidth)
+			&& sumsquare_fillshort(sq, msum) ? 1 : -1;
+	} else if (printstyle == 2) {
+		return sumsquare_readreduced(sq, text, 0, base, fixedwidth)
+			? 1 : -1;
+	} else if (printstyle == 3) {
+		return sumsquare_readdecimal(sq, text, ',') ? 1 : -1;
+	}
+	return -1;
+}
+
+/** Reads from the given file one square printed with the given print style,
+ * returning 1 if it was read, 0 at the end of the file or -1 if the text is
+ * not valid, like sumsquare_parse. The squares of the binary styles must be
+ * read after the header of the file. */
+int sumsquare_read(sumsquare sq, FILE *f, char printstyle, unsigned char base,
+			unsigned char fixedwidth) {
+	char text[SUMSQ_MAXLINELEN];
+	const char *t = text;
+	int i, len = 0, side = sumsquare_side(sq);
+	if (printstyle == 5 || printstyle == 6) {
+		len = fread(text, 1, sumsquare_binarylen(side, printstyle == 5),
+				f);
+	} else {
+		for (i = 0; i <= (printstyle == 4 ? side : 0)
+				&& len < SUMSQ_MAXLINELEN - 1; i++) {
+			if (fgets(text + len, SUMSQ_MAXLINELEN - len, f)
+					== NULL) {
+				break;
+			}
+			len += strlen(text + len);
+			if (text[len - 1] != '\n') {
+				text[len++] = '\n';
+			}
+		}
+	}
+	return sumsquare_parse(sq, &t, text + len, printstyle, base,
+				fixedwidth);
+}
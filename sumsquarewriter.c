@@ -0,0 +1,226 @@
+/**
+ * sumsquarewriter - Buffer to write squares of type sumsquare in the styles of
+ * sumsquareio, encoding each square in one pass with tables of the digits of
+ * every number and writing big blocks with write(2) instead of printing each
+ * character with stdio. The buffer is written before it cannot save one more
+ * square, so a square is never split, and when it is shared with other writers
+ * the descriptor can be locked by saving a mutex in lock. To create a writer
+ * of squares of side N with a buffer of S bytes, a char array of size
+ * SUMSQUARE_WRITER_BYTES(N, S) must be initialized by calling to
+ * sumsquare_writer_init(array, N, S, fd, base, fixedwidth) that returns the
+ * array of type sumsquare_writer, and it must be flushed at the end.
+ *
+ * Copyright 2021 Carlos Rica (jasampler)
+ * This file is part of the jasampler's magic-square project.
+ */
+#include <assert.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+
+/* maximum width of a number in a base, the width of 255 in base 2 */
+#define SUMSQ_WRITER_MAXWIDTH 8
+/* bytes of a decimal number, its length and 3 digits */
+#define SUMSQ_WRITER_DECWIDTH 4
+/* maximum bytes of a square in any style */
+#define SUMSQ_WRITER_MAXLEN(side) \
+	(SUMSQ_SIDEX(side) * (SUMSQ_WRITER_MAXWIDTH + 4) + (side) + 2)
+
+typedef struct sumsquare_writer_st {
+	int fd, len, size, maxlen;
+	unsigned long long nbytes;
+	unsigned char side, fixedwidth, tablewidth, nbits;
+	char *buf, *fixedcodes, *deccodes;
+	pthread_mutex_t *lock;
+} *sumsquare_writer;
+
+#define SUMSQUARE_WRITER_BYTES(side, size) \
+	(sizeof(struct sumsquare_writer_st) + (size) \
+		+ ((SUMSQ_SIDEX(side) + 1) * SUMSQ_WRITER_MAXWIDTH) \
+		+ ((SUMSQ_SIDEX(side) + 1) * SUMSQ_WRITER_DECWIDTH))
+
+/** Must receive as arguments an array of SUMSQUARE_WRITER_BYTES(N, S) bytes,
+ * the same numbers N and S, that must be at least SUMSQ_WRITER_MAXLEN(N), the
+ * file descriptor to write and the base and the width of the reduced styles,
+ * and returns the same array initialized as a sumsquare_writer. */
+sumsquare_writer sumsquare_writer_init(char *mem, int side, int size, int fd,
+				unsigned char base, unsigned char fixedwidth) {
+	sumsquare_writer w = (sumsquare_writer) mem;
+	int n, m, k, ncells = SUMSQ_SIDEX(side);
+	char *code;
+	assert(size >= SUMSQ_WRITER_MAXLEN(side));
+	assert(fixedwidth <= SUMSQ_WRITER_MAXWIDTH);
+	w->fd = fd;
+	w->len = 0;
+	w->nbytes = 0;
+	w->size = size;
+	w->maxlen = SUMSQ_WRITER_MAXLEN(side);
+	w->side = side;
+	w->fixedwidth = fixedwidth;
+	w->tablewidth = ncells < 10 ? 1 : ncells < 100 ? 2 : 3;
+	w->nbits = sumsquare_binarybits(side);
+	w->buf = (char *) (w + 1);
+	w->fixedcodes = w->buf + size;
+	w->deccodes = w->fixedcodes + (ncells + 1) * SUMSQ_WRITER_MAXWIDTH;
+	w->lock = NULL;
+	for (n = 0; n <= ncells; n++) {
+		code = w->fixedcodes + n * SUMSQ_WRITER_MAXWIDTH;
+		for (k = fixedwidth - 1, m = n; k >= 0; k--, m /= base) {
+			code[k] = DIGITS[m % base];
+		}
+		code = w->deccodes + n * SUMSQ_WRITER_DECWIDTH;
+		code[0] = n < 10 ? 1 : n < 100 ? 2 : 3;
+		for (k = code[0], m = n; k > 0; k--, m /= 10) {
+			code[k] = '0' + m % 10;
+		}
+	}
+	return w;
+}
+
+/** Writes the squares saved in the buffer with write(2), locking the lock if
+ * there is one, and returns 0 if they could not be written. The bytes written
+ * are added to nbytes. */
+char sumsquare_writer_flush(sumsquare_writer w) {
+	int off = 0;
+	ssize_t n;
+	char r = 1;
+	if (w->lock) {
+		pthread_mutex_lock(w->lock);
+	}
+	while (off < w->len) {
+		n = write(w->fd, w->buf + off, w->len - off);
+		if (n > 0) {
+			off += n;
+			w->nbytes += n;
+		} else if (n == 0 || errno != EINTR) {
+			perror("Cannot write the squares");
+			r = 0;
+			break;
+		}
+	}
+	if (w->lock) {
+		pthread_mutex_unlock(w->lock);
+	}
+	w->len = 0;
+	return r;
+}
+
+/* returns the end of the buffer, written before if a square could not fit */
+static char *sumsquare_writer_end(sumsquare_writer w) {
+	if (w->size - w->len < w->maxlen) {
+		sumsquare_writer_flush(w);
+	}
+	return w->buf + w->len;
+}
+
+/* copies the decimal number of the given code to the given text */
+#define SUMSQ_WRITER_COPYDEC(text, code) \
+	do { \
+		memcpy(text, (code) + 1, 3); \
+		text += (code)[0]; \
+	} while (0)
+
+/** Writes the rows of decimal numbers separated by spaces and an empty line. */
+void sumsquare_write(sumsquare_writer w, sumsquare sq) {
+	int i, j, k, side = w->side, tablewidth = w->tablewidth;
+	char *text = sumsquare_writer_end(w), *code;
+	for (i = 0; i < side; i++) {
+		for (j = 0; j < side; j++) {
+			code = w->deccodes + sumsquare_getnum(sq, i * side + j)
+				* SUMSQ_WRITER_DECWIDTH;
+			if (j) {
+				*text++ = ' ';
+			}
+			for (k = code[0]; k < tablewidth; k++) {
+				*text++ = ' ';
+			}
+			SUMSQ_WRITER_COPYDEC(text, code);
+		}
+		*text++ = '\n';
+	}
+	*text++ = '\n';
+	w->len = text - w->buf;
+}
+
+/** Writes one line of decimal numbers separated by commas, with empty holes. */
+void sumsquare_writeline(sumsquare_writer w, sumsquare sq) {
+	int p, n, ncells = SUMSQ_SIDEX(w->side);
+	char *text = sumsquare_writer_end(w);
+	for (p = 0; p < ncells; p++) {
+		if (p) {
+			*text++ = ',';
+		}
+		n = sumsquare_getnum(sq, p);
+		if (n) {
+			SUMSQ_WRITER_COPYDEC(text,
+				w->deccodes + n * SUMSQ_WRITER_DECWIDTH);
+		}
+	}
+	*text++ = '\n';
+	w->len = text - w->buf;
+}
+
+/** Writes the numbers of the square with fixed width and without separation.
+ * The short format removes the last column, last row and the 2nd number in the
+ * row previous to the last, since these can be calculated in magic squares. */
+void sumsquare_writereduced(sumsquare_writer w, sumsquare sq, char shortformat){
+	int i, j, side = w->side, fixedwidth = w->fixedwidth;
+	int maxline = shortformat ? side - 1 : side;
+	int skipi = shortformat ? side - 2 : -1;
+	int skipj = shortformat ? 1 : -1;
+	char *text = sumsquare_writer_end(w);
+	for (i = 0; i < maxline; i++) {
+		for (j = 0; j < maxline; j++) {
+			if (i != skipi || j != skipj) {
+				memcpy(text, w->fixedcodes
+					+ sumsquare_getnum(sq, i * side + j)
+					* SUMSQ_WRITER_MAXWIDTH, fixedwidth);
+				text += fixedwidth;
+			}
+		}
+	}
+	*text++ = '\n';
+	w->len = text - w->buf;
+}
+
+/** Writes the header of the binary styles, that must be written once at the
+ * start of the file, with the side, the given filter level and the format. */
+void sumsquare_writeheader(sumsquare_writer w, char filterlevel,
+				char shortformat) {
+	char *text = sumsquare_writer_end(w);
+	memcpy(text, SUMSQ_BINARY_MAGIC, 4);
+	text[4] = w->side;
+	text[5] = filterlevel;
+	text[6] = shortformat;
+	text[7] = w->nbits;
+	w->len += SUMSQ_BINARY_HEADERLEN;
+}
+
+/** Writes the numbers of the short or the long reduced format minus one packed
+ * in nbits bits each, from the most significant bit of each byte, padding the
+ * last byte with zeros. */
+void sumsquare_writebinary(sumsquare_writer w, sumsquare sq, char shortformat){
+	int i, j, side = w->side, nbits = w->nbits, nacc = 0;
+	int maxline = shortformat ? side - 1 : side;
+	int skipi = shortformat ? side - 2 : -1;
+	int skipj = shortformat ? 1 : -1;
+	unsigned int acc = 0;
+	char *text = sumsquare_writer_end(w);
+	for (i = 0; i < maxline; i++) {
+		for (j = 0; j < maxline; j++) {
+			if (i != skipi || j != skipj) {
+				acc = (acc << nbits) | (sumsquare_getnum(sq,
+						i * side + j) - 1);
+				nacc += nbits;
+				if (nacc >= 8) {
+					nacc -= 8;
+					*text++ = acc >> nacc;
+				}
+			}
+		}
+	}
+	if (nacc) {
+		*text++ = acc << (8 - nacc);
+	}
+	w->len = text - w->buf;
+}